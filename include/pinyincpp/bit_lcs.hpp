@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace pinyincpp {
+
+// bit-parallel longest common subsequence (Hyyro) of texts against a fixed query,
+// one bit per text position, so each query symbol costs one word op per 64 text positions
+template <class T>
+struct BitLcs {
+private:
+    std::vector<T> symbols; // sorted distinct query symbols
+    std::vector<std::uint32_t> querySlots; // index into symbols of each query symbol
+    std::size_t textLen = 0;
+    std::size_t numWords = 0;
+    std::vector<std::uint64_t> masks; // numWords per distinct symbol, bit i set if text[i] matches it
+    std::vector<std::uint64_t> columns; // numWords per query prefix, bit i clear if text[i] is the last of an lcs
+
+    void match(std::size_t i, T const &c) {
+        auto it = std::lower_bound(symbols.begin(), symbols.end(), c);
+        if (it != symbols.end() && *it == c) {
+            masks[(it - symbols.begin()) * numWords + i / 64] |= std::uint64_t(1) << (i % 64);
+        }
+    }
+
+    bool bit(std::size_t j, std::size_t i) const noexcept {
+        return columns[j * numWords + i / 64] >> (i % 64) & 1;
+    }
+
+    // the lcs length of text[0, i) and query[0, j)
+    std::size_t lcsAt(std::size_t i, std::size_t j) const noexcept {
+        std::uint64_t const *v = columns.data() + j * numWords;
+        std::size_t ones = 0;
+        for (std::size_t w = 0; w < i / 64; ++w) {
+            ones += std::popcount(v[w]);
+        }
+        if (i % 64) {
+            ones += std::popcount(v[i / 64] & ((std::uint64_t(1) << (i % 64)) - 1));
+        }
+        return i - ones;
+    }
+
+public:
+    explicit BitLcs(std::span<T const> query)
+    : symbols(query.begin(), query.end()) {
+        std::sort(symbols.begin(), symbols.end());
+        symbols.erase(std::unique(symbols.begin(), symbols.end()), symbols.end());
+        querySlots.reserve(query.size());
+        for (auto const &c : query) {
+            querySlots.push_back(std::lower_bound(symbols.begin(), symbols.end(), c) - symbols.begin());
+        }
+    }
+
+    std::size_t querySize() const noexcept {
+        return querySlots.size();
+    }
+
+    // text is a sequence of symbols, or of sets of symbols that each match any query symbol in them,
+    // returns the lcs length, the columns are kept for traceback until the next run
+    template <class Text>
+    std::size_t run(Text const &text) {
+        textLen = text.size();
+        numWords = (textLen + 63) / 64;
+        masks.assign(symbols.size() * numWords, 0);
+        for (std::size_t i = 0; i < textLen; ++i) {
+            if constexpr (std::is_convertible_v<decltype(text[i]), T const &>) {
+                match(i, text[i]);
+            } else {
+                for (auto const &c : text[i]) {
+                    match(i, c);
+                }
+            }
+        }
+        std::size_t m = querySlots.size();
+        columns.resize((m + 1) * numWords);
+        std::fill_n(columns.begin(), numWords, ~std::uint64_t(0));
+        for (std::size_t j = 0; j < m; ++j) {
+            std::uint64_t const *v = columns.data() + j * numWords;
+            std::uint64_t const *mask = masks.data() + querySlots[j] * numWords;
+            std::uint64_t *out = columns.data() + (j + 1) * numWords;
+            // V' = (V + U) | (V - U) where U = V & mask, with carry and borrow across words
+            std::uint64_t carry = 0, borrow = 0;
+            for (std::size_t w = 0; w < numWords; ++w) {
+                std::uint64_t u = v[w] & mask[w];
+                std::uint64_t sum = v[w] + u;
+                std::uint64_t carryOut = sum < u;
+                sum += carry;
+                carryOut |= sum < carry;
+                std::uint64_t diff = v[w] - u;
+                std::uint64_t borrowOut = v[w] < u;
+                borrowOut |= diff < borrow;
+                diff -= borrow;
+                out[w] = sum | diff;
+                carry = carryOut;
+                borrow = borrowOut;
+            }
+        }
+        return lcsAt(textLen, m);
+    }
+
+    // ascending text positions of one lcs of the last run, chosen the same way as tracing back the dp table:
+    // drop text chars first, then query chars, and match only when neither keeps the length
+    std::vector<std::size_t> traceback() const {
+        std::vector<std::size_t> matches;
+        std::size_t i = textLen, j = querySlots.size();
+        std::size_t current = numWords ? lcsAt(i, j) : 0;
+        while (i > 0 && j > 0 && current > 0) {
+            if (bit(j, i - 1)) {
+                --i;
+                continue;
+            }
+            std::size_t left = lcsAt(i, j - 1);
+            if (left == current) {
+                --j;
+            } else {
+                matches.push_back(i - 1);
+                --i;
+                --j;
+                --current;
+            }
+        }
+        std::reverse(matches.begin(), matches.end());
+        return matches;
+    }
+};
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace pinyincpp {
+
+namespace crc32_detail {
+
+// slicing-by-8 tables of the reflected IEEE polynomial, tables[k][b] is the crc of b followed by k zero bytes
+inline constexpr auto kTables = [] {
+    std::array<std::array<std::uint32_t, 256>, 8> tables{};
+    for (std::uint32_t b = 0; b < 256; ++b) {
+        std::uint32_t crc = b;
+        for (int i = 0; i < 8; ++i) {
+            crc = crc & 1 ? crc >> 1 ^ 0xEDB88320u : crc >> 1;
+        }
+        tables[0][b] = crc;
+    }
+    for (std::size_t k = 1; k < 8; ++k) {
+        for (std::uint32_t b = 0; b < 256; ++b) {
+            tables[k][b] = tables[k - 1][b] >> 8 ^ tables[0][tables[k - 1][b] & 0xFF];
+        }
+    }
+    return tables;
+}();
+
+}
+
+// the crc-32 of zlib and python's zlib.crc32, crc32(b, crc32(a)) == crc32(a + b)
+inline std::uint32_t crc32(std::string_view bytes, std::uint32_t crc = 0) noexcept {
+    auto const &t = crc32_detail::kTables;
+    auto p = reinterpret_cast<const unsigned char *>(bytes.data());
+    auto n = bytes.size();
+    crc = ~crc;
+    for (; n >= 8; p += 8, n -= 8) {
+        std::uint32_t lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+        if constexpr (std::endian::native == std::endian::big) {
+            lo = __builtin_bswap32(lo);
+            hi = __builtin_bswap32(hi);
+        }
+        lo ^= crc;
+        crc = t[7][lo & 0xFF] ^ t[6][lo >> 8 & 0xFF] ^ t[5][lo >> 16 & 0xFF] ^ t[4][lo >> 24]
+            ^ t[3][hi & 0xFF] ^ t[2][hi >> 8 & 0xFF] ^ t[1][hi >> 16 & 0xFF] ^ t[0][hi >> 24];
+    }
+    for (; n; ++p, --n) {
+        crc = crc >> 8 ^ t[0][(crc ^ *p) & 0xFF];
+    }
+    return ~crc;
+}
+
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <iterator>
 #include <string>
 #include <string_view>
 #include <pinyincpp/utf8.hpp>
@@ -8,73 +10,384 @@
 
 namespace pinyincpp {
 
-inline char16_t gbkToUnicode(std::uint16_t gbk) {
-    std::uint16_t hi = static_cast<std::uint8_t>(gbk >> 8);
-    std::uint16_t lo = static_cast<std::uint8_t>(gbk & 0xFF);
+// gbk and gb18030 conversion with the tables of data/gbk.bin and data/gbk-inv.bin resolved once, gb18030
+// adds the two-byte codes gbk leaves undefined and the four-byte codes, taken from kRanges below U+10000
+// and by offset above it; malformed input decodes to U+FFFD and chars without a code encode to '?'
+struct GbkCodec {
+    enum class Charset {
+        kGbk,
+        kGb18030,
+    };
+
+private:
+    struct Range {
+        std::uint32_t index; // linear four-byte index, (((b1 - 0x81) * 10 + b2 - 0x30) * 126 + b3 - 0x81) * 10 + b4 - 0x30
+        char32_t codepoint;
+    };
+
+    struct Run {
+        std::uint32_t index; // into gbk.bin, (b1 - 0x81) * 191 + b2 - 0x40
+        char32_t codepoint;
+        std::uint32_t size;
+    };
 
-    auto gbk_bin = CMakeResource("data/gbk.bin").data();
+    // tables printed by scripts/data_generate/gb18030-tables.py: two-byte codes gbk leaves undefined
+    static constexpr Run kTwoByteExtras[] = {
+        {6112, 0xE4C6, 63}, {6176, 0xE505, 33}, {6303, 0xE526, 63}, {6367, 0xE565, 33}, {6410, 0xE766, 6},
+        {6466, 0x20AC, 1}, {6467, 0xE76D, 1}, {6478, 0xE76E, 2}, {6492, 0xE770, 2}, {6494, 0xE586, 63},
+        {6558, 0xE5C5, 33}, {6685, 0xE5E6, 63}, {6749, 0xE625, 33}, {6865, 0xE772, 11}, {6876, 0xE646, 63},
+        {6940, 0xE685, 33}, {7059, 0xE77D, 8}, {7067, 0xE6A6, 63}, {7131, 0xE6E5, 33}, {7188, 0xE785, 8},
+        {7220, 0xE78D, 7}, {7239, 0xE794, 2}, {7246, 0xE796, 1}, {7249, 0xE797, 9}, {7258, 0xE706, 63},
+        {7322, 0xE745, 33}, {7388, 0xE7A0, 15}, {7436, 0xE7AF, 13}, {7535, 0xE7BC, 11}, {7573, 0xE7C7, 1},
+        {7576, 0x01F9, 1}, {7578, 0xE7C9, 4}, {7619, 0xE7CD, 21}, {7664, 0xE7E2, 1}, {7667, 0xE7E3, 1},
+        {7669, 0xE7E4, 3}, {7713, 0x303E, 1}, {7714, 0x2FF0, 12}, {7727, 0xE7F4, 13}, {7816, 0xE801, 15},
+        {7928, 0xE000, 94}, {8119, 0xE05E, 94}, {8310, 0xE0BC, 94}, {8501, 0xE11A, 94}, {8692, 0xE178, 94},
+        {8883, 0xE1D6, 94}, {16612, 0xE810, 5}, {22826, 0xE234, 94}, {23017, 0xE292, 94}, {23208, 0xE2F0, 94},
+        {23399, 0xE34E, 94}, {23590, 0xE3AC, 94}, {23781, 0xE40A, 94}, {23891, 0x2E81, 1}, {23892, 0xE816, 3},
+        {23895, 0x2E84, 1}, {23896, 0x3473, 1}, {23897, 0x3447, 1}, {23898, 0x2E88, 1}, {23899, 0x2E8B, 1},
+        {23900, 0xE81E, 1}, {23901, 0x359E, 1}, {23902, 0x361A, 1}, {23903, 0x360E, 1}, {23904, 0x2E8C, 1},
+        {23905, 0x2E97, 1}, {23906, 0x396E, 1}, {23907, 0x3918, 1}, {23908, 0xE826, 1}, {23909, 0x39CF, 1},
+        {23910, 0x39DF, 1}, {23911, 0x3A73, 1}, {23912, 0x39D0, 1}, {23913, 0xE82B, 2}, {23915, 0x3B4E, 1},
+        {23916, 0x3C6E, 1}, {23917, 0x3CE0, 1}, {23918, 0x2EA7, 1}, {23919, 0xE831, 2}, {23921, 0x2EAA, 1},
+        {23922, 0x4056, 1}, {23923, 0x415F, 1}, {23924, 0x2EAE, 1}, {23925, 0x4337, 1}, {23926, 0x2EB3, 1},
+        {23927, 0x2EB6, 2}, {23929, 0xE83B, 1}, {23930, 0x43B1, 1}, {23931, 0x43AC, 1}, {23932, 0x2EBB, 1},
+        {23933, 0x43DD, 1}, {23934, 0x44D6, 1}, {23935, 0x4661, 1}, {23936, 0x464C, 1}, {23937, 0xE843, 1},
+        {23939, 0x4723, 1}, {23940, 0x4729, 1}, {23941, 0x477C, 1}, {23942, 0x478D, 1}, {23943, 0x2ECA, 1},
+        {23944, 0x4947, 1}, {23945, 0x497A, 1}, {23946, 0x497D, 1}, {23947, 0x4982, 2}, {23949, 0x4985, 2},
+        {23951, 0x499F, 1}, {23952, 0x499B, 1}, {23953, 0x49B7, 1}, {23954, 0x49B6, 1}, {23955, 0xE854, 2},
+        {23957, 0x4CA3, 1}, {23958, 0x4C9F, 3}, {23961, 0x4C77, 1}, {23962, 0x4CA2, 1}, {23963, 0x4D13, 7},
+        {23970, 0x4DAE, 1}, {23971, 0xE864, 1}, {23972, 0xE468, 94},
+    };
+    // four-byte codes below U+10000
+    static constexpr Range kRanges[] = {
+        {0, 0x0080}, {36, 0x00A5}, {38, 0x00A9}, {45, 0x00B2}, {50, 0x00B8}, {81, 0x00D8}, {89, 0x00E2},
+        {95, 0x00EB}, {96, 0x00EE}, {100, 0x00F4}, {103, 0x00F8}, {104, 0x00FB}, {105, 0x00FD}, {109, 0x0102},
+        {126, 0x0114}, {133, 0x011C}, {148, 0x012C}, {172, 0x0145}, {175, 0x0149}, {179, 0x014E}, {208, 0x016C},
+        {306, 0x01CF}, {307, 0x01D1}, {308, 0x01D3}, {309, 0x01D5}, {310, 0x01D7}, {311, 0x01D9}, {312, 0x01DB},
+        {313, 0x01DD}, {341, 0x01FA}, {428, 0x0252}, {443, 0x0262}, {544, 0x02C8}, {545, 0x02CC}, {558, 0x02DA},
+        {741, 0x03A2}, {742, 0x03AA}, {749, 0x03C2}, {750, 0x03CA}, {805, 0x0402}, {819, 0x0450}, {820, 0x0452},
+        {7922, 0x2011}, {7924, 0x2017}, {7925, 0x201A}, {7927, 0x201E}, {7934, 0x2027}, {7943, 0x2031},
+        {7944, 0x2034}, {7945, 0x2036}, {7950, 0x203C}, {8062, 0x20AD}, {8148, 0x2104}, {8149, 0x2106},
+        {8152, 0x210A}, {8164, 0x2117}, {8174, 0x2122}, {8236, 0x216C}, {8240, 0x217A}, {8262, 0x2194},
+        {8264, 0x219A}, {8374, 0x2209}, {8380, 0x2210}, {8381, 0x2212}, {8384, 0x2216}, {8388, 0x221B},
+        {8390, 0x2221}, {8392, 0x2224}, {8393, 0x2226}, {8394, 0x222C}, {8396, 0x222F}, {8401, 0x2238},
+        {8406, 0x223E}, {8416, 0x2249}, {8419, 0x224D}, {8424, 0x2253}, {8437, 0x2262}, {8439, 0x2268},
+        {8445, 0x2270}, {8482, 0x2296}, {8485, 0x229A}, {8496, 0x22A6}, {8521, 0x22C0}, {8603, 0x2313},
+        {8936, 0x246A}, {8946, 0x249C}, {9046, 0x254C}, {9050, 0x2574}, {9063, 0x2590}, {9066, 0x2596},
+        {9076, 0x25A2}, {9092, 0x25B4}, {9100, 0x25BE}, {9108, 0x25C8}, {9111, 0x25CC}, {9113, 0x25D0},
+        {9131, 0x25E6}, {9162, 0x2607}, {9164, 0x260A}, {9218, 0x2641}, {9219, 0x2643}, {11329, 0x2E82},
+        {11331, 0x2E85}, {11334, 0x2E89}, {11336, 0x2E8D}, {11346, 0x2E98}, {11361, 0x2EA8}, {11363, 0x2EAB},
+        {11366, 0x2EAF}, {11370, 0x2EB4}, {11372, 0x2EB8}, {11375, 0x2EBC}, {11389, 0x2ECB}, {11682, 0x2FFC},
+        {11686, 0x3004}, {11687, 0x3018}, {11692, 0x301F}, {11694, 0x302A}, {11714, 0x303F}, {11716, 0x3094},
+        {11723, 0x309F}, {11725, 0x30F7}, {11730, 0x30FF}, {11736, 0x312A}, {11982, 0x322A}, {11989, 0x3232},
+        {12102, 0x32A4}, {12336, 0x3390}, {12348, 0x339F}, {12350, 0x33A2}, {12384, 0x33C5}, {12393, 0x33CF},
+        {12395, 0x33D3}, {12397, 0x33D6}, {12510, 0x3448}, {12553, 0x3474}, {12851, 0x359F}, {12962, 0x360F},
+        {12973, 0x361B}, {13738, 0x3919}, {13823, 0x396F}, {13919, 0x39D1}, {13933, 0x39E0}, {14080, 0x3A74},
+        {14298, 0x3B4F}, {14585, 0x3C6F}, {14698, 0x3CE1}, {15583, 0x4057}, {15847, 0x4160}, {16318, 0x4338},
+        {16434, 0x43AD}, {16438, 0x43B2}, {16481, 0x43DE}, {16729, 0x44D7}, {17102, 0x464D}, {17122, 0x4662},
+        {17315, 0x4724}, {17320, 0x472A}, {17402, 0x477D}, {17418, 0x478E}, {17859, 0x4948}, {17909, 0x497B},
+        {17911, 0x497E}, {17915, 0x4984}, {17916, 0x4987}, {17936, 0x499C}, {17939, 0x49A0}, {17961, 0x49B8},
+        {18664, 0x4C78}, {18703, 0x4CA4}, {18814, 0x4D1A}, {18962, 0x4DAF}, {19043, 0x9FA6}, {33469, 0xE76C},
+        {33470, 0xE7C8}, {33471, 0xE7E7}, {33484, 0xE815}, {33485, 0xE819}, {33490, 0xE81F}, {33497, 0xE827},
+        {33501, 0xE82D}, {33505, 0xE833}, {33513, 0xE83C}, {33520, 0xE844}, {33536, 0xE856}, {33550, 0xE865},
+        {37845, 0xF92D}, {37921, 0xF97A}, {37948, 0xF996}, {38029, 0xF9E8}, {38038, 0xF9F2}, {38064, 0xFA10},
+        {38065, 0xFA12}, {38066, 0xFA15}, {38069, 0xFA19}, {38075, 0xFA22}, {38076, 0xFA25}, {38078, 0xFA2A},
+        {39108, 0xFE32}, {39109, 0xFE45}, {39113, 0xFE53}, {39114, 0xFE58}, {39115, 0xFE67}, {39116, 0xFE6C},
+        {39265, 0xFF5F}, {39394, 0xFFE6},
+    };
+    static constexpr std::uint32_t kNumBmpIndices = 39420;
+    static constexpr std::uint32_t kSupplementaryIndex = 189000; // of 0x90 0x30 0x81 0x30, U+10000
+    static constexpr std::size_t kNumTrails = 0xFE - 0x40 + 1; // one row of gbk.bin per lead byte
+    static constexpr std::uint16_t kUnmapped = 0x3F00; // as written by gbk-inv.bin.py
 
-    if (0x81 <= hi && hi <= 0xFE && 0x40 <= lo && lo <= 0xFE) {
-        auto base = reinterpret_cast<const char16_t *>(gbk_bin);
-        auto index = (hi - 0x81) * (0xFE - 0x40) + lo - 0x40;
-        return base[index];
-    } else {
+    char16_t const *decodeTable;
+    char16_t const *encodeTable; // 0xFFFF entries, the first byte in the low byte
+    Charset charset;
+
+    static char32_t fourByteToUnicode(std::uint32_t index) noexcept {
+        if (index < kNumBmpIndices) {
+            auto it = std::upper_bound(std::begin(kRanges), std::end(kRanges), index, [] (std::uint32_t index, Range const &r) {
+                return index < r.index;
+            });
+            --it;
+            return it->codepoint + (index - it->index);
+        }
+        if (kSupplementaryIndex <= index && index < kSupplementaryIndex + 0x100000) {
+            return 0x10000 + (index - kSupplementaryIndex);
+        }
         return 0xFFFD;
     }
-}
 
-inline std::uint16_t unicodeToGbk(char16_t code) {
-    auto gbk_inv_bin = CMakeResource("data/gbk-inv.bin").data();
+    // linear four-byte index of c, or -1 if c has a two-byte code or none
+    static std::uint32_t unicodeToFourByte(char32_t c) noexcept {
+        if (c >= 0x10000) {
+            return c <= 0x10FFFF ? kSupplementaryIndex + (c - 0x10000) : (std::uint32_t)-1;
+        }
+        auto it = std::upper_bound(std::begin(kRanges), std::end(kRanges), c, [] (char32_t c, Range const &r) {
+            return c < r.codepoint;
+        });
+        if (it == std::begin(kRanges)) {
+            return (std::uint32_t)-1;
+        }
+        std::uint32_t end = it == std::end(kRanges) ? kNumBmpIndices : it->index;
+        --it;
+        std::uint32_t index = it->index + (c - it->codepoint);
+        return index < end ? index : (std::uint32_t)-1;
+    }
 
-    auto base = reinterpret_cast<const char16_t *>(gbk_inv_bin);
-    auto index = static_cast<std::uint16_t>(code);
-    return base[index];
-}
+    template <class Wide>
+    static void append(std::basic_string<Wide> &out, char32_t c) {
+        if constexpr (sizeof(Wide) == sizeof(char16_t)) {
+            if (c >= 0x10000) {
+                out.push_back(static_cast<Wide>(0xD800 + ((c - 0x10000) >> 10)));
+                out.push_back(static_cast<Wide>(0xDC00 + ((c - 0x10000) & 0x3FF)));
+                return;
+            }
+        }
+        out.push_back(static_cast<Wide>(c));
+    }
 
-template <typename Wide = char16_t>
-inline std::basic_string<Wide> gbkToUnicode(std::string_view str) {
-    std::basic_string<Wide> result;
-    int phase = 0;
-    std::uint8_t hi;
-    for (std::size_t i = 0; i < str.size();) {
-        std::uint8_t ch = static_cast<std::uint8_t>(str[i]);
-        if (0x81 <= ch && ch <= 0xFE) {
-            phase = 1;
-            hi = ch;
-            i++;
-        } else {
-            if (phase == 1) {
-                auto lo = ch;
-                char32_t code = 0xFFFD;
-                if (0x40 <= lo && lo <= 0xFE) {
-                    auto gbk = (hi << 8) | lo;
-                    code = gbkToUnicode(gbk);
+public:
+    explicit GbkCodec(Charset charset = Charset::kGb18030)
+    : decodeTable(reinterpret_cast<const char16_t *>(CMakeResource("data/gbk.bin").data()))
+    , encodeTable(reinterpret_cast<const char16_t *>(CMakeResource("data/gbk-inv.bin").data()))
+    , charset(charset) {}
+
+    static GbkCodec const &gbk() {
+        static GbkCodec const codec(Charset::kGbk);
+        return codec;
+    }
+
+    static GbkCodec const &gb18030() {
+        static GbkCodec const codec(Charset::kGb18030);
+        return codec;
+    }
+
+    // a two-byte code, lead byte in the high byte
+    char32_t decodeChar(std::uint16_t code) const noexcept {
+        std::uint16_t hi = code >> 8;
+        std::uint16_t lo = code & 0xFF;
+        if (0x81 <= hi && hi <= 0xFE && 0x40 <= lo && lo <= 0xFE) [[likely]] {
+            std::uint32_t index = (hi - 0x81) * kNumTrails + (lo - 0x40);
+            char32_t c = decodeTable[index];
+            if (c == 0xFFFD && charset == Charset::kGb18030) [[unlikely]] {
+                auto it = std::upper_bound(std::begin(kTwoByteExtras), std::end(kTwoByteExtras), index, [] (std::uint32_t index, Run const &r) {
+                    return index < r.index;
+                });
+                if (it != std::begin(kTwoByteExtras) && index - (--it)->index < it->size) {
+                    c = it->codepoint + (index - it->index);
                 }
-                result.push_back(code);
-            } else {
-                result.push_back(ch);
             }
-            phase = 0;
-            i++;
+            return c;
         }
+        return 0xFFFD;
     }
-    if (phase == 1) {
-        result.push_back(0xFFFD);
+
+    // bytes of c appended to out
+    void encodeChar(char32_t c, std::string &out) const {
+        if (c < 0x80) [[likely]] {
+            out.push_back(static_cast<char>(c));
+            return;
+        }
+        if (c < 0xFFFF && (c < 0xD800 || c > 0xDFFF)) {
+            std::uint16_t code = encodeTable[c];
+            if (code != kUnmapped) {
+                out.push_back(static_cast<char>(code & 0xFF));
+                if (code > 0xFF) {
+                    out.push_back(static_cast<char>(code >> 8));
+                }
+                return;
+            }
+        }
+        if (charset == Charset::kGb18030) {
+            // rare enough for a scan, the runs are not sorted by code point
+            for (auto const &r : kTwoByteExtras) {
+                if (c - r.codepoint < r.size) {
+                    std::uint32_t index = r.index + (c - r.codepoint);
+                    out.push_back(static_cast<char>(0x81 + index / kNumTrails));
+                    out.push_back(static_cast<char>(0x40 + index % kNumTrails));
+                    return;
+                }
+            }
+        }
+        std::uint32_t index;
+        if (charset == Charset::kGb18030 && (c < 0xD800 || c > 0xDFFF) && (index = unicodeToFourByte(c)) != (std::uint32_t)-1) {
+            char bytes[4];
+            bytes[3] = static_cast<char>(0x30 + index % 10);
+            index /= 10;
+            bytes[2] = static_cast<char>(0x81 + index % 126);
+            index /= 126;
+            bytes[1] = static_cast<char>(0x30 + index % 10);
+            bytes[0] = static_cast<char>(0x81 + index / 10);
+            out.append(bytes, 4);
+            return;
+        }
+        out.push_back('?');
     }
-    return result;
+
+    // decodes bytes fed in chunks of any size, an incomplete code at the end of a chunk is carried over
+    struct Decoder {
+    private:
+        GbkCodec const *codec;
+        std::uint8_t pending[3];
+        std::uint8_t pendingSize = 0;
+
+        template <class Wide>
+        void push(std::uint8_t byte, std::basic_string<Wide> &out) {
+            switch (pendingSize) {
+            case 0:
+                if (byte < 0x80) {
+                    out.push_back(static_cast<Wide>(byte));
+                } else if (byte == 0x80) {
+                    out.push_back(static_cast<Wide>(0x20AC));
+                } else if (byte == 0xFF) {
+                    out.push_back(static_cast<Wide>(0xFFFD));
+                } else {
+                    pending[pendingSize++] = byte;
+                }
+                return;
+            case 1:
+                if (0x40 <= byte && byte <= 0xFE) {
+                    pendingSize = 0;
+                    append(out, codec->decodeChar(pending[0] << 8 | byte));
+                } else if (codec->charset == Charset::kGb18030 && 0x30 <= byte && byte <= 0x39) {
+                    pending[pendingSize++] = byte;
+                } else {
+                    // an ascii byte is not eaten by the broken code
+                    pendingSize = 0;
+                    out.push_back(static_cast<Wide>(0xFFFD));
+                    if (byte < 0x80) {
+                        out.push_back(static_cast<Wide>(byte));
+                    }
+                }
+                return;
+            case 2:
+                if (0x81 <= byte && byte <= 0xFE) {
+                    pending[pendingSize++] = byte;
+                    return;
+                }
+                break;
+            default:
+                if (0x30 <= byte && byte <= 0x39) {
+                    pendingSize = 0;
+                    std::uint32_t index = (((pending[0] - 0x81) * 10 + (pending[1] - 0x30)) * 126 + (pending[2] - 0x81)) * 10 + (byte - 0x30);
+                    append(out, fourByteToUnicode(index));
+                    return;
+                }
+                break;
+            }
+            // a broken four-byte code, the bytes after its lead byte are read again
+            std::uint8_t rest[3];
+            std::size_t numRest = 0;
+            for (std::size_t i = 1; i < pendingSize; ++i) {
+                rest[numRest++] = pending[i];
+            }
+            rest[numRest++] = byte;
+            pendingSize = 0;
+            out.push_back(static_cast<Wide>(0xFFFD));
+            for (std::size_t i = 0; i < numRest; ++i) {
+                push(rest[i], out);
+            }
+        }
+
+    public:
+        explicit Decoder(GbkCodec const &codec) noexcept : codec(&codec) {}
+
+        template <class Wide>
+        void feed(std::string_view chunk, std::basic_string<Wide> &out) {
+            for (std::size_t i = 0; i < chunk.size(); ++i) {
+                if (!pendingSize && static_cast<std::uint8_t>(chunk[i]) < 0x80) {
+                    // ascii runs copied at once
+                    std::size_t j = i + 1;
+                    while (j < chunk.size() && static_cast<std::uint8_t>(chunk[j]) < 0x80) {
+                        ++j;
+                    }
+                    out.append(chunk.begin() + i, chunk.begin() + j);
+                    i = j - 1;
+                    continue;
+                }
+                push(static_cast<std::uint8_t>(chunk[i]), out);
+            }
+        }
+
+        // end of input: an incomplete code decodes to U+FFFD
+        template <class Wide>
+        void finish(std::basic_string<Wide> &out) {
+            if (pendingSize) {
+                pendingSize = 0;
+                out.push_back(static_cast<Wide>(0xFFFD));
+            }
+        }
+    };
+
+    Decoder decoder() const noexcept {
+        return Decoder(*this);
+    }
+
+    template <class Wide = char32_t>
+    std::basic_string<Wide> decode(std::string_view bytes) const {
+        std::basic_string<Wide> out;
+        out.reserve(bytes.size());
+        auto d = decoder();
+        d.feed(bytes, out);
+        d.finish(out);
+        return out;
+    }
+
+    // utf-16 input has its surrogate pairs joined, lone surrogates encode to '?'
+    template <class Wide>
+    void encode(std::basic_string_view<Wide> str, std::string &out) const {
+        out.reserve(out.size() + str.size() * 2);
+        for (std::size_t i = 0; i < str.size(); ++i) {
+            char32_t c = static_cast<char32_t>(str[i]);
+            if (c < 0x80) {
+                std::size_t j = i + 1;
+                while (j < str.size() && static_cast<char32_t>(str[j]) < 0x80) {
+                    ++j;
+                }
+                for (; i < j; ++i) {
+                    out.push_back(static_cast<char>(str[i]));
+                }
+                --i;
+                continue;
+            }
+            if constexpr (sizeof(Wide) == sizeof(char16_t)) {
+                if (0xD800 <= c && c < 0xDC00 && i + 1 < str.size() && 0xDC00 <= str[i + 1] && str[i + 1] <= 0xDFFF) {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (static_cast<char32_t>(str[i + 1]) - 0xDC00);
+                    ++i;
+                }
+            }
+            encodeChar(c, out);
+        }
+    }
+
+    template <class Wide>
+    std::string encode(std::basic_string_view<Wide> str) const {
+        std::string out;
+        encode(str, out);
+        return out;
+    }
+};
+
+inline char16_t gbkToUnicode(std::uint16_t gbk) {
+    return static_cast<char16_t>(GbkCodec::gbk().decodeChar(gbk));
+}
+
+// first byte in the low byte, '?' if code has no gbk code
+inline std::uint16_t unicodeToGbk(char16_t code) {
+    std::string bytes;
+    GbkCodec::gbk().encodeChar(code, bytes);
+    return bytes.size() > 1 ? static_cast<std::uint8_t>(bytes[0]) | static_cast<std::uint8_t>(bytes[1]) << 8 : static_cast<std::uint8_t>(bytes[0]);
+}
+
+template <typename Wide = char16_t>
+inline std::basic_string<Wide> gbkToUnicode(std::string_view str) {
+    return GbkCodec::gbk().decode<Wide>(str);
 }
 
 template <typename Wide = char16_t>
 inline std::string unicodeToGbk(std::basic_string_view<Wide> str) {
-    std::string result;
-    for (std::size_t i = 0; i < str.size(); i++) {
-        auto gbk = unicodeToGbk(str[i]);
-        result.push_back(static_cast<std::uint8_t>(gbk & 0xFF));
-        if (gbk > 0xFF) {
-            result.push_back(static_cast<std::uint8_t>(gbk >> 8));
-        }
-    }
-    return result;
+    return GbkCodec::gbk().encode(str);
 }
 
 inline std::string gbkToUtfC(std::string_view str) {
@@ -58,7 +58,7 @@ public:
 
     template <std::input_iterator It, std::sentinel_for<It> Ite>
     explicit InlineVector(It first, Ite last) {
-        if (std::distance(first, last) <= N) {
+        if (static_cast<std::size_t>(std::distance(first, last)) <= N) {
             auto &store = m_variant.template emplace<0>();
             store.m_size = 0;
             for (; first != last; ++first) {
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace pinyincpp {
+
+// read-only memory mapping of a whole file, pages are shared between processes mapping the same file
+struct MappedFile {
+private:
+    const char *m_data = nullptr;
+    std::size_t m_size = 0;
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#endif
+
+public:
+    MappedFile() noexcept = default;
+
+    explicit MappedFile(std::string const &path) {
+#ifdef _WIN32
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE) [[unlikely]] {
+            throw std::runtime_error("MappedFile cannot open file: " + path);
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size)) [[unlikely]] {
+            CloseHandle(m_file);
+            throw std::runtime_error("MappedFile cannot stat file: " + path);
+        }
+        m_size = static_cast<std::size_t>(size.QuadPart);
+        if (m_size == 0) {
+            return;
+        }
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_mapping) [[unlikely]] {
+            CloseHandle(m_file);
+            throw std::runtime_error("MappedFile cannot map file: " + path);
+        }
+        m_data = static_cast<const char *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!m_data) [[unlikely]] {
+            CloseHandle(m_mapping);
+            CloseHandle(m_file);
+            throw std::runtime_error("MappedFile cannot map file: " + path);
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) [[unlikely]] {
+            throw std::runtime_error("MappedFile cannot open file: " + path);
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0) [[unlikely]] {
+            ::close(fd);
+            throw std::runtime_error("MappedFile cannot stat file: " + path);
+        }
+        m_size = static_cast<std::size_t>(st.st_size);
+        if (m_size == 0) {
+            ::close(fd);
+            return;
+        }
+        void *p = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) [[unlikely]] {
+            throw std::runtime_error("MappedFile cannot map file: " + path);
+        }
+        m_data = static_cast<const char *>(p);
+#endif
+    }
+
+    MappedFile(MappedFile &&that) noexcept
+    : m_data(std::exchange(that.m_data, nullptr))
+    , m_size(std::exchange(that.m_size, 0))
+#ifdef _WIN32
+    , m_file(std::exchange(that.m_file, INVALID_HANDLE_VALUE))
+    , m_mapping(std::exchange(that.m_mapping, nullptr))
+#endif
+    {}
+
+    MappedFile &operator=(MappedFile &&that) noexcept {
+        if (this != &that) {
+            this->~MappedFile();
+            new (this) MappedFile(std::move(that));
+        }
+        return *this;
+    }
+
+    ~MappedFile() noexcept {
+#ifdef _WIN32
+        if (m_data) UnmapViewOfFile(m_data);
+        if (m_mapping) CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+#else
+        if (m_data) ::munmap(const_cast<char *>(m_data), m_size);
+#endif
+    }
+
+    const char *data() const noexcept {
+        return m_data;
+    }
+
+    std::size_t size() const noexcept {
+        return m_size;
+    }
+
+    std::string_view view() const noexcept {
+        return {m_data, m_size};
+    }
+};
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <pinyincpp/suffix_array.hpp>
+
+namespace pinyincpp {
+
+// char unigram counts and next-char counts for every context of 1 to kMaxContext chars in a text
+struct NgramTable {
+    static constexpr std::size_t kMaxContext = 4;
+
+    struct NextChar {
+        char32_t character;
+        std::uint32_t count;
+    };
+
+private:
+    struct Context {
+        std::array<char32_t, kMaxContext> chars;
+
+        explicit Context(std::u32string_view context) noexcept {
+            chars.fill((char32_t)-1);
+            std::copy(context.begin(), context.end(), chars.begin());
+        }
+
+        bool operator==(Context const &other) const noexcept = default;
+    };
+
+    struct ContextHash {
+        std::size_t operator()(Context const &context) const noexcept {
+            std::uint64_t h = 0xcbf29ce484222325ull;
+            for (char32_t c : context.chars) {
+                h = (h ^ c) * 0x100000001b3ull;
+            }
+            return static_cast<std::size_t>(h ^ (h >> 32));
+        }
+    };
+
+    std::unordered_map<char32_t, std::uint32_t> unigrams;
+    std::unordered_map<Context, std::pair<std::uint32_t, std::uint32_t>, ContextHash> contexts;
+    std::vector<NextChar> nextChars;
+
+public:
+    NgramTable() = default;
+
+    // next chars of each context are read off the contiguous groups of the suffix array
+    NgramTable(std::u32string_view text, SuffixArray const &index) {
+        for (char32_t c : text) {
+            ++unigrams[c];
+        }
+        std::size_t n = index.size();
+        for (std::size_t len = 1; len <= kMaxContext; ++len) {
+            std::size_t j = 0;
+            while (j < n) {
+                if (index[j] + len >= n) {
+                    ++j;
+                    continue;
+                }
+                auto context = text.substr(index[j], len);
+                auto first = static_cast<std::uint32_t>(nextChars.size());
+                while (j < n && index[j] + len < n && text.substr(index[j], len) == context) {
+                    char32_t c = text[index[j] + len];
+                    std::uint32_t count = 0;
+                    for (; j < n && index[j] + len < n && text[index[j] + len] == c
+                         && text.substr(index[j], len) == context; ++j) {
+                        ++count;
+                    }
+                    nextChars.push_back({c, count});
+                }
+                contexts.try_emplace(Context(context), first, static_cast<std::uint32_t>(nextChars.size()) - first);
+            }
+        }
+        nextChars.shrink_to_fit();
+    }
+
+    std::unordered_map<char32_t, std::uint32_t> const &unigramCounts() const noexcept {
+        return unigrams;
+    }
+
+    std::uint32_t unigramCount(char32_t c) const {
+        auto it = unigrams.find(c);
+        return it == unigrams.end() ? 0 : it->second;
+    }
+
+    // chars following context, with their counts, context must be 1 to kMaxContext chars
+    std::span<NextChar const> next(std::u32string_view context) const {
+        if (context.empty() || context.size() > kMaxContext) [[unlikely]] {
+            return {};
+        }
+        auto it = contexts.find(Context(context));
+        if (it == contexts.end()) {
+            return {};
+        }
+        return {nextChars.data() + it->second.first, it->second.second};
+    }
+};
+
+}
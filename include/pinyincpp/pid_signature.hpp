@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <pinyincpp/pinyin_chars.hpp>
+
+namespace pinyincpp {
+
+// 256 bit bloom signature of the pids (special chars included) a candidate can produce
+struct PidSignature {
+private:
+    std::array<std::uint64_t, 4> bits{};
+
+    static std::uint32_t slot(Pid pid) noexcept {
+        return (static_cast<std::uint32_t>(pid) * 0x9e3779b1u) >> 24;
+    }
+
+public:
+    PidSignature() = default;
+
+    template <class PidSets>
+    static PidSignature fromPidSets(PidSets const &sets) {
+        PidSignature signature;
+        for (auto const &set : sets) {
+            for (Pid pid : set) {
+                signature.add(pid);
+            }
+        }
+        return signature;
+    }
+
+    void add(Pid pid) noexcept {
+        auto s = slot(pid);
+        bits[s / 64] |= std::uint64_t(1) << (s % 64);
+    }
+
+    bool mayContain(Pid pid) const noexcept {
+        auto s = slot(pid);
+        return bits[s / 64] >> (s % 64) & 1;
+    }
+
+    // upper bound of the lcs length between the candidate and query: query pids the candidate may have
+    std::size_t possibleMatches(std::span<Pid const> query) const noexcept {
+        std::size_t count = 0;
+        for (Pid pid : query) {
+            count += mayContain(pid);
+        }
+        return count;
+    }
+
+    std::size_t popcount() const noexcept {
+        std::size_t count = 0;
+        for (auto word : bits) {
+            count += std::popcount(word);
+        }
+        return count;
+    }
+};
+
+}
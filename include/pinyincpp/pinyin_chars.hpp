@@ -4,16 +4,22 @@
 #include <cstdint>
 #include <sstream>
 #include <algorithm>
+#include <iterator>
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <string_view>
+#include <type_traits>
 #include <vector>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <span>
 #include <pinyincpp/resources.hpp>
 #include <pinyincpp/debug.hpp>
 #include <pinyincpp/utf8.hpp>
 #include <pinyincpp/bytes_reader.hpp>
-#include <pinyincpp/resources.hpp>
 #include <pinyincpp/inline_vector.hpp>
+#include <pinyincpp/mapped_file.hpp>
+#include <pinyincpp/pinyin_snapshot.hpp>
 
 namespace pinyincpp {
 
@@ -41,150 +47,164 @@ struct PidTone {
 using PidSet = InlineVector<Pid, 2>;
 using PidToneSet = InlineVector<PidTone, 4>;
 
-struct PinyinDB {
-    struct CharInfo {
-        char32_t character;
-        float logFrequency;
-        auto tuplify() const { return std::tie(character, logFrequency); }
-    };
+// decodes readings packed as pid << 3 | tone without copying them out
+struct PidToneView {
+    struct iterator {
+        using value_type = PidTone;
+        using difference_type = std::ptrdiff_t;
+        using reference = PidTone;
+        using iterator_category = std::input_iterator_tag;
 
-    struct PinyinInfo {
-        float logFrequency;
-        PidToneSet pinyin;
-        auto tuplify() const { return std::tie(logFrequency, pinyin); }
+        std::uint16_t const *p = nullptr;
+
+        PidTone operator*() const noexcept { return {static_cast<Pid>(*p >> 3), static_cast<std::uint8_t>(*p & 7)}; }
+        iterator &operator++() noexcept { ++p; return *this; }
+        iterator operator++(int) noexcept { return {p++}; }
+        bool operator==(iterator const &other) const noexcept { return p == other.p; }
+        bool operator!=(iterator const &other) const noexcept { return p != other.p; }
     };
 
+    std::span<std::uint16_t const> packed;
+
+    iterator begin() const noexcept { return {packed.data()}; }
+    iterator end() const noexcept { return {packed.data() + packed.size()}; }
+    std::size_t size() const noexcept { return packed.size(); }
+    bool empty() const noexcept { return packed.empty(); }
+    PidTone operator[](std::size_t i) const noexcept { return *iterator{packed.data() + i}; }
+    operator PidToneSet() const { return PidToneSet(begin(), end()); }
+};
+
+struct PinyinDB {
+    using CharInfo = PinyinCharInfo;
+
 private:
-    struct CharData : CharInfo {
-        PidToneSet pinyin;
-        auto tuplify() const { return std::tuple_cat(CharInfo::tuplify(), std::tie(pinyin)); }
-    };
+    std::shared_ptr<void const> storage;
+    PinyinSnapshot snapshot;
 
-    std::vector<CharData> charData;
-    std::vector<std::string> pinyinData;
-    std::unordered_map<std::string, Pid> lookupPinyinToPid;
-    std::unordered_set<std::string> lookupPinyinPrefixSet;
-    std::unordered_map<Pid, std::vector<CharInfo>> lookupPinyinToChar;
-    std::unordered_map<char32_t, PinyinInfo> lookupCharToPinyin;
+    PinyinDB(std::shared_ptr<void const> storage, std::string_view bytes, bool verifyChecksum)
+    : storage(std::move(storage)), snapshot(PinyinSnapshot::open(bytes, verifyChecksum)) {}
 
-public:
-    PinyinDB() {
-        {
-            BytesReader f = CMakeResource("data/pinyin.bin").view();
-            auto nPids = f.read32();
-            pinyinData.reserve(nPids);
-            for (Pid pid = 0; pid < nPids; pid++) {
-                auto pinyin = f.reads(6);
-                pinyin.resize(std::strlen(pinyin.c_str()));
-                lookupPinyinToPid.emplace(pinyin, pid);
-                pinyinData.push_back(std::move(pinyin));
-            }
-            auto nChars = f.read32();
-            charData.reserve(nChars);
-            for (std::size_t i = 0; i < nChars; ++i) {
-                char32_t c = f.read24();
-                double logProb = (double)f.read16() / 4096;
-                auto nPidTones = f.read8();
-                PidToneSet pidToneSet;
-                pidToneSet.reserve(nPidTones);
-                for (std::size_t j = 0; j < nPidTones; ++j) {
-                    std::uint16_t pidTone = f.read16();
-                    Pid pid = pidTone >> 3;
-                    std::uint8_t tone = pidTone & 7;
-                    pidToneSet.push_back({pid, tone});
-                }
-                charData.push_back({
-                    c, static_cast<float>(logProb),
-                    std::move(pidToneSet),
-                });
-            }
+    static PinyinDB fromCompiled(std::vector<std::uint32_t> words, bool verifyChecksum = false) {
+        auto owner = std::make_shared<std::vector<std::uint32_t>>(std::move(words));
+        std::string_view bytes{reinterpret_cast<const char *>(owner->data()), owner->size() * sizeof(std::uint32_t)};
+        return PinyinDB(std::move(owner), bytes, verifyChecksum);
+    }
+
+    static PinyinDB fromStatic(std::string_view bytes) {
+        if (reinterpret_cast<std::uintptr_t>(bytes.data()) % 4 != 0) [[unlikely]] {
+            std::vector<std::uint32_t> words((bytes.size() + 3) / 4);
+            std::memcpy(words.data(), bytes.data(), bytes.size());
+            return fromCompiled(std::move(words));
         }
-        for (const auto &c : charData) {
-            std::unordered_set<Pid> addedPinyin;
-            for (auto const &p : c.pinyin) {
-                if (addedPinyin.insert(p.pid).second) {
-                    lookupPinyinToChar[p.pid].push_back(static_cast<CharInfo const &>(c));
-                }
-            }
-            auto &pinInfo = lookupCharToPinyin[c.character];
-            pinInfo.logFrequency = c.logFrequency;
-            for (auto const &p: c.pinyin) {
-                pinInfo.pinyin.push_back(p);
-            }
+        return PinyinDB(nullptr, bytes, false);
+    }
+
+public:
+    // parses data/pinyin.bin and compiles it into a private snapshot image
+    PinyinDB() : PinyinDB(fromCompiled(PinyinSnapshot::compile(CMakeResource("data/pinyin.bin").view()))) {}
+
+    // maps a snapshot written by saveSnapshot, the pages are shared by every process opening the same file
+    static PinyinDB openSnapshot(std::string const &path) {
+        auto file = std::make_shared<MappedFile>(path);
+        auto bytes = file->view();
+        return PinyinDB(std::move(file), bytes, true);
+    }
+
+    // copies a snapshot image from memory, e.g. one just downloaded, so bytes need not outlive the db
+    static PinyinDB loadSnapshot(std::string_view bytes) {
+        std::vector<std::uint32_t> words((bytes.size() + 3) / 4);
+        std::memcpy(words.data(), bytes.data(), bytes.size());
+        return fromCompiled(std::move(words), true);
+    }
+
+    // uses the embedded data/pinyin.snap in place, which the build compiles from data/pinyin.bin with
+    // pinyincpp-snapshot, so the pages are shared and nothing is allocated; in hex resource mode it is not
+    // baked and this compiles data/pinyin.bin into a private heap image like PinyinDB()
+    static PinyinDB fromResource() {
+        if constexpr (!CMakeResource::contains("data/pinyin.snap")) {
+            return PinyinDB();
+        } else {
+            return fromStatic(CMakeResource("data/pinyin.snap").view());
         }
-        for (const auto &[p, pid] : lookupPinyinToPid) {
-            for (std::size_t i = 1; i <= p.size(); ++i) {
-                lookupPinyinPrefixSet.insert(p.substr(0, i));
-            }
+    }
+
+    void saveSnapshot(std::string const &path) const {
+        auto bytes = snapshot.bytes();
+        std::ofstream fout(path, std::ios::binary);
+        fout.write(bytes.data(), bytes.size());
+        if (!fout) [[unlikely]] {
+            throw std::runtime_error("PinyinDB cannot write snapshot: " + path);
         }
     }
 
-    Pid pinyinId(std::string const &pinyin) {
-        auto it = lookupPinyinToPid.find(pinyin);
-        if (it == lookupPinyinToPid.end()) [[unlikely]] {
+    Pid pinyinId(std::string const &pinyin) const {
+        auto pid = snapshot.findPinyin(pinyin);
+        if (pid < 0) [[unlikely]] {
             return makeSpecialPid(0);
         } else {
-            return it->second;
+            return pid;
         }
     }
 
+    // the underlying tables, e.g. to walk the syllable automaton
+    PinyinSnapshot const &snapshotView() const noexcept {
+        return snapshot;
+    }
+
     Pid pinyinPidLimit() const noexcept {
-        return pinyinData.size();
+        return snapshot.numPinyins();
     }
 
-    std::string pinyinName(Pid pinyin) {
+    std::string pinyinName(Pid pinyin) const {
         if (isSpecialPid(pinyin)) {
             return utf32toC(extractSpecialPid(pinyin));
         }
-        if (pinyin >= pinyinData.size()) [[unlikely]] {
+        if (pinyin >= pinyinPidLimit()) [[unlikely]] {
             return {};
         }
-        return pinyinData[pinyin];
+        return std::string(snapshot.pinyinName(pinyin));
     }
 
-    std::vector<CharInfo> pinyinToChar(Pid p) {
-        auto it = lookupPinyinToChar.find(p);
-        if (it == lookupPinyinToChar.end()) {
+    std::span<CharInfo const> pinyinToChar(Pid p) const {
+        if (isSpecialPid(p)) {
             return {};
-        } else {
-            return it->second;
         }
+        return snapshot.pinyinChars(p);
     }
 
-    PidToneSet *charToPinyinToned(char32_t character) {
-        auto it = lookupCharToPinyin.find(character);
-        if (it == lookupCharToPinyin.end()) {
-            return nullptr;
+    std::optional<PidToneView> charToPinyinToned(char32_t character) const {
+        auto index = snapshot.findChar(character);
+        if (index == PinyinSnapshot::npos) {
+            return std::nullopt;
         } else {
-            return &it->second.pinyin;
+            return PidToneView{snapshot.charPidTones(index)};
         }
     }
 
-    PidSet charToPinyin(char32_t character) {
-        auto it = lookupCharToPinyin.find(character);
-        if (it == lookupCharToPinyin.end()) {
+    PidSet charToPinyin(char32_t character) const {
+        auto pids = charPinyins(character);
+        return PidSet(pids.begin(), pids.end());
+    }
+
+    // same as charToPinyin without copying, deduplicated when the snapshot was compiled
+    std::span<Pid const> charPinyins(char32_t character) const noexcept {
+        auto index = snapshot.findChar(character);
+        if (index == PinyinSnapshot::npos) {
             return {};
-        } else {
-            PidSet pidSet;
-            std::unordered_set<Pid> addedPinyin;
-            for (auto p: it->second.pinyin) {
-                if (addedPinyin.insert(p.pid).second) {
-                    pidSet.push_back(p.pid);
-                }
-            }
-            return pidSet;
         }
+        return snapshot.charPids(index);
     }
 
-    double charLogFrequency(char32_t character) {
-        auto it = lookupCharToPinyin.find(character);
-        if (it == lookupCharToPinyin.end()) {
+    double charLogFrequency(char32_t character) const {
+        auto index = snapshot.findChar(character);
+        if (index == PinyinSnapshot::npos) {
             return 0;
         } else {
-            return it->second.logFrequency;
+            return snapshot.charFrequency(index);
         }
     }
-    std::vector<PidToneSet> stringToPinyinToned(std::u32string const &str, bool ignoreCase = false) {
+
+    std::vector<PidToneSet> stringToPinyinToned(std::u32string const &str, bool ignoreCase = false) const {
         std::vector<PidToneSet> result;
         result.reserve(str.size());
         for (char32_t c : str) {
@@ -200,7 +220,7 @@ public:
         return result;
     }
 
-    std::vector<PidSet> stringToPinyin(std::u32string const &str, bool ignoreCase = false) {
+    std::vector<PidSet> stringToPinyin(std::u32string const &str, bool ignoreCase = false) const {
         std::vector<PidSet> result;
         result.reserve(str.size());
         for (char32_t c : str) {
@@ -209,12 +229,13 @@ public:
                     c += 'a' - 'A';
                 }
             }
-            result.emplace_back(charToPinyin(c)).push_back(makeSpecialPid(c));
+            auto pids = charPinyins(c);
+            result.emplace_back(pids.begin(), pids.end()).push_back(makeSpecialPid(c));
         }
         return result;
     }
 
-    std::vector<std::vector<std::string>> simpleStringToPinyin(std::string const &str) {
+    std::vector<std::vector<std::string>> simpleStringToPinyin(std::string const &str) const {
         std::vector<std::vector<std::string>> result;
         auto str32 = utfCto32(str);
         result.reserve(str32.size());
@@ -233,132 +254,134 @@ public:
         return result;
     }
 
-    std::vector<Pid> pinyinSplit(std::u32string const &pinyin, bool ignoreCase = false,
-                                 char32_t sepChar = U' ', std::vector<std::size_t> *indices = nullptr) {
-        std::vector<Pid> result;
-        std::string token;
+    // a position where splitting may restart from scratch: pids emitted before it only depend on the chars
+    // up to position + 1 (the n/g back-off looks one char past it), so later edits keep the first numPids pids
+    struct SplitCheckpoint {
+        std::size_t position;
+        std::size_t numPids;
+    };
+
+    // allocation free pinyinSplit walking the syllable automaton of the snapshot, writes pids to pidOut
+    // and, unless indexOut or checkpointOut is nullptr, the end position of each pid in pinyin to indexOut
+    // and every SplitCheckpoint to checkpointOut
+    template <std::output_iterator<Pid> PidOut, class IndexOut = std::nullptr_t, class CheckpointOut = std::nullptr_t>
+    PidOut pinyinSplit(std::u32string_view pinyin, PidOut pidOut, bool ignoreCase = false,
+                       char32_t sepChar = U' ', IndexOut indexOut = nullptr, CheckpointOut checkpointOut = nullptr) const {
+        std::size_t numPids = 0;
+        auto emit = [&] (Pid pid, std::size_t index) {
+            ++numPids;
+            *pidOut++ = pid;
+            if constexpr (!std::is_same_v<IndexOut, std::nullptr_t>) {
+                *indexOut++ = index;
+            }
+        };
+        auto lower = [&] (char32_t c) {
+            if (ignoreCase && 'A' <= c && c <= 'Z') {
+                c += 'a' - 'A';
+            }
+            return c;
+        };
+        // chars of the prefix spelled by state, as specials, the last one ending at end
+        auto emitChars = [&] (std::uint32_t state, std::size_t end, bool skipSep) {
+            char chars[PinyinSnapshot::kNameSize];
+            std::size_t n = snapshot.syllableState(state).depth;
+            for (std::size_t k = n; k-- > 0; state = snapshot.syllableState(state).parent) {
+                chars[k] = snapshot.syllableState(state).last;
+            }
+            for (std::size_t k = 0; k < n; ++k) {
+                char32_t c = chars[k];
+                if (!skipSep || c != sepChar) {
+                    *pidOut++ = makeSpecialPid(lower(c));
+                    ++numPids;
+                }
+                if constexpr (!std::is_same_v<IndexOut, std::nullptr_t>) {
+                    *indexOut++ = end - (n - 1 - k);
+                }
+            }
+        };
+        // the pending token is always a pinyin prefix, kept as its automaton state,
+        // after a failed prefix at a non-letter it is left over and extended by the next letter
+        std::uint32_t token = 0;
         bool status = false;
         for (std::size_t i = 0; i < pinyin.size(); ++i) {
+            if constexpr (!std::is_same_v<CheckpointOut, std::nullptr_t>) {
+                if (!token && !status) {
+                    *checkpointOut++ = SplitCheckpoint{i, numPids};
+                }
+            }
             auto c = pinyin[i];
             if ('a' <= c && c <= 'z') {
-                token.push_back(c);
-                auto it = lookupPinyinPrefixSet.find(token);
-                if (it != lookupPinyinPrefixSet.end()) {
-                    if (!status) {
-                        status = true;
-                    } else {
-                        auto it = lookupPinyinPrefixSet.find(token);
-                        if (it == lookupPinyinPrefixSet.end()) {
-                            std::size_t off = token.size();
-                            for (char32_t c : token) {
-                                result.push_back(makeSpecialPid(c));
-                                --off;
-                                if (indices) indices->push_back(pinyin.size() - off);
-                            }
-                        }
-                    }
-                } else {
-                    if (status) {
-                        token.pop_back();
-                        auto it = lookupPinyinToPid.find(token);
-                        if (it != lookupPinyinToPid.end()) {
-                            if (token.size() >= 2) {
-                                auto b = token.back();
-                                if (b == 'n' || b == 'g') {
-                                    if (std::string("aeiouv").find((char)c) != std::string::npos) {
-                                        char tmpToken[] = {b, (char)c, '\0'};
-                                        auto tmpIt = lookupPinyinToPid.find(tmpToken);
-                                        if (tmpIt != lookupPinyinToPid.end()) {
-                                            token.pop_back();
-                                            tmpIt = lookupPinyinToPid.find(token);
-                                            if (tmpIt != lookupPinyinToPid.end()) {
-                                                it = tmpIt;
-                                                --i;
-                                            } else {
-                                                token.push_back(b);
-                                            }
-                                        }
-                                    }
+                if (auto next = snapshot.syllableNext(token, c)) {
+                    token = next;
+                    status = true;
+                    continue;
+                }
+                if (status) {
+                    auto const &state = snapshot.syllableState(token);
+                    Pid pid = state.pid;
+                    if (pid >= 0) {
+                        // n or g starting the next syllable, e.g. fangan -> fan gan
+                        auto b = state.last;
+                        if (state.depth >= 2 && (b == 'n' || b == 'g') && std::u32string_view(U"aeiouv").find(c) != std::u32string_view::npos) {
+                            auto bc = snapshot.syllableNext(snapshot.syllableNext(0, (char32_t)b), c);
+                            if (bc && snapshot.syllableState(bc).pid >= 0) {
+                                Pid tmpPid = snapshot.syllableState(state.parent).pid;
+                                if (tmpPid >= 0) {
+                                    pid = tmpPid;
+                                    --i;
                                 }
                             }
-                            result.push_back(it->second);
-                            if (indices) indices->push_back(i);
-                        } else {
-                            std::size_t off = token.size();
-                            for (char32_t c : token) {
-                                result.push_back(makeSpecialPid(c));
-                                --off;
-                                if (indices) indices->push_back(i - off);
-                            }
                         }
-                        status = false;
-                        --i;
+                        emit(pid, i);
                     } else {
-                        if (c != sepChar) {
-                            if (ignoreCase) {
-                                if ('A' <= c && c <= 'Z') {
-                                    c += 'a' - 'A';
-                                }
-                            }
-                            result.push_back(makeSpecialPid(c));
-                            if (indices) indices->push_back(i + 1);
-                        }
+                        emitChars(token, i, false);
+                    }
+                    status = false;
+                    --i;
+                } else {
+                    if (c != sepChar) {
+                        emit(makeSpecialPid(lower(c)), i + 1);
                     }
-                    token.clear();
                 }
+                token = 0;
             } else {
                 if (status) {
-                    auto it = lookupPinyinToPid.find(token);
-                    if (it != lookupPinyinToPid.end()) {
-                        result.push_back(it->second);
-                        if (indices) indices->push_back(i);
-                        token.clear();
-                    }
-                    std::size_t off = token.size();
-                    for (char32_t c : token) {
-                        result.push_back(makeSpecialPid(c));
-                        --off;
-                        if (indices) indices->push_back(i - off);
+                    Pid pid = snapshot.syllableState(token).pid;
+                    if (pid >= 0) {
+                        emit(pid, i);
+                        token = 0;
                     }
+                    emitChars(token, i, false);
                     status = false;
                 }
                 if (c != sepChar) {
-                    if (ignoreCase) {
-                        if ('A' <= c && c <= 'Z') {
-                            c += 'a' - 'A';
-                        }
-                    }
-                    result.push_back(makeSpecialPid(c));
-                    if (indices) indices->push_back(i + 1);
+                    emit(makeSpecialPid(lower(c)), i + 1);
                 }
             }
         }
-        if (status != 0) {
-            auto it = lookupPinyinToPid.find(token);
-            if (it != lookupPinyinToPid.end()) {
-                result.push_back(it->second);
-                if (indices) indices->push_back(pinyin.size());
+        if (status) {
+            Pid pid = snapshot.syllableState(token).pid;
+            if (pid >= 0) {
+                emit(pid, pinyin.size());
             } else {
-                std::size_t off = token.size();
-                for (char32_t c : token) {
-                    if (c != sepChar) {
-                        if (ignoreCase) {
-                            if ('A' <= c && c <= 'Z') {
-                                c += 'a' - 'A';
-                            }
-                        }
-                        result.push_back(makeSpecialPid(c));
-                    }
-                    --off;
-                    if (indices) indices->push_back(pinyin.size() - off);
-                }
+                emitChars(token, pinyin.size(), true);
             }
-            status = 0;
+        }
+        return pidOut;
+    }
+
+    std::vector<Pid> pinyinSplit(std::u32string const &pinyin, bool ignoreCase = false,
+                                 char32_t sepChar = U' ', std::vector<std::size_t> *indices = nullptr) const {
+        std::vector<Pid> result;
+        if (indices) {
+            pinyinSplit(std::u32string_view(pinyin), std::back_inserter(result), ignoreCase, sepChar, std::back_inserter(*indices));
+        } else {
+            pinyinSplit(std::u32string_view(pinyin), std::back_inserter(result), ignoreCase, sepChar);
         }
         return result;
     }
 
-    std::vector<std::string> simplePinyinSplit(std::string const &pinyin, bool ignoreCase = false, char32_t sepChar = U' ') {
+    std::vector<std::string> simplePinyinSplit(std::string const &pinyin, bool ignoreCase = false, char32_t sepChar = U' ') const {
         auto pinyin32 = utfCto32(pinyin);
         auto pids = pinyinSplit(pinyin32, ignoreCase, sepChar);
         std::vector<std::string> result;
@@ -369,7 +392,7 @@ public:
         return result;
     }
 
-    std::string pinyinConcat(std::vector<Pid> const &pids, char32_t sepChar = U' ') {
+    std::string pinyinConcat(std::vector<Pid> const &pids, char32_t sepChar = U' ') const {
         std::string result;
         bool first = true;
         for (auto p: pids) {
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <pinyincpp/utf8.hpp>
+#include <pinyincpp/pinyin_chars.hpp>
+#include <pinyincpp/pinyin_words.hpp>
+#include <pinyincpp/pinyin_lattice.hpp>
+
+namespace pinyincpp {
+
+// whole sentence pinyin to hanzi conversion: a lattice over the pid sequence with an edge per dictionary
+// word and per frequent char of each pid, searched by a beam of the best distinct texts at each position,
+// chars of each pid are cached, so a decoder should be reused with the same PinyinDB
+struct PinyinDecoder {
+    static constexpr double kEdgePenalty = 8.0; // per word or char, so fewer and longer words are preferred
+    static constexpr std::size_t kCharsPerPid = 4;
+    static constexpr std::size_t kMaxWordSyllables = 8;
+    static constexpr std::size_t kMinBeamWidth = 8;
+
+    struct Sentence {
+        std::u32string text;
+        std::vector<std::size_t> boundaries; // pid position where each word or char ends
+        double score;
+    };
+
+private:
+    struct Edge {
+        std::uint32_t begin;
+        std::uint32_t end;
+        std::uint32_t firstChar; // range into text
+        std::uint32_t numChars;
+        double score;
+    };
+
+    std::vector<Edge> edges;
+    std::u32string text;
+    std::unordered_map<Pid, std::vector<PinyinCharInfo>> charCache;
+
+    std::vector<PinyinCharInfo> const &frequentChars(PinyinDB const &db, Pid pid) {
+        auto [it, success] = charCache.try_emplace(pid);
+        if (success) {
+            auto chars = db.pinyinToChar(pid);
+            auto &top = it->second;
+            top.resize(std::min(kCharsPerPid, chars.size()));
+            std::partial_sort_copy(chars.begin(), chars.end(), top.begin(), top.end(), [] (PinyinCharInfo const &a, PinyinCharInfo const &b) {
+                return a.logFrequency > b.logFrequency;
+            });
+        }
+        return it->second;
+    }
+
+    void addEdge(std::size_t begin, std::size_t end, std::u32string_view chars, double score) {
+        edges.push_back({static_cast<std::uint32_t>(begin), static_cast<std::uint32_t>(end),
+                         static_cast<std::uint32_t>(text.size()), static_cast<std::uint32_t>(chars.size()), score});
+        text.append(chars);
+    }
+
+    void buildLattice(PinyinDB const &db, PinyinWordsDB const &wd, std::vector<Pid> const &pids) {
+        edges.clear();
+        text.clear();
+        std::vector<Pid> run;
+        for (std::size_t i = 0; i < pids.size(); ++i) {
+            if (isSpecialPid(pids[i])) {
+                char32_t c = extractSpecialPid(pids[i]);
+                addEdge(i, i + 1, std::u32string_view(&c, 1), -kEdgePenalty);
+                continue;
+            }
+            auto const &chars = frequentChars(db, pids[i]);
+            for (auto const &c : chars) {
+                addEdge(i, i + 1, std::u32string_view(&c.character, 1), c.logFrequency - kEdgePenalty);
+            }
+            if (chars.empty()) [[unlikely]] {
+                addEdge(i, i + 1, utfCto32(db.pinyinName(pids[i])), -2 * kEdgePenalty);
+            }
+            run.clear();
+            auto cursor = wd.cursor();
+            for (std::size_t j = i; j < pids.size() && j - i < kMaxWordSyllables && !isSpecialPid(pids[j]); ++j) {
+                run.push_back(pids[j]);
+                if (!(cursor = wd.advance(cursor, pids[j]))) {
+                    break;
+                }
+                if (run.size() < 2) {
+                    continue;
+                }
+                // words scored per syllable, the same scale as a char of the same length
+                wd.visitItems(cursor, run, [&] (std::vector<Pid> const &, std::size_t const &wordIndex) {
+                    auto w = wd.wordData[wordIndex];
+                    addEdge(i, j + 1, utf16to32(w.word), w.score * run.size() - kEdgePenalty);
+                    return false;
+                }, 1);
+            }
+        }
+        std::stable_sort(edges.begin(), edges.end(), [] (Edge const &a, Edge const &b) {
+            return a.end < b.end;
+        });
+    }
+
+public:
+    // the k best distinct conversions of the whole pid sequence, pids from pinyinSplit, specials kept as is
+    std::vector<Sentence> decode(PinyinDB const &db, PinyinWordsDB const &wd, std::vector<Pid> const &pids,
+                                 std::size_t k = 5, std::size_t beamWidth = kMinBeamWidth) {
+        std::vector<Sentence> sentences;
+        if (!k || pids.empty()) [[unlikely]] {
+            return sentences;
+        }
+        buildLattice(db, wd, pids);
+        // the same text reached through different words only keeps its best segmentation
+        auto found = kBestPaths<char32_t>(std::span<Edge const>(edges), pids.size(), k, std::max(beamWidth, k), [this] (Edge const &edge, auto &&visit) {
+            for (std::uint32_t c = edge.firstChar; c < edge.firstChar + edge.numChars; ++c) {
+                visit(text[c]);
+            }
+        });
+        for (auto const &f : found) {
+            auto &sentence = sentences.emplace_back();
+            sentence.score = f.score;
+            for (auto e : f.edges) {
+                sentence.text.append(text, edges[e].firstChar, edges[e].numChars);
+                sentence.boundaries.push_back(edges[e].end);
+            }
+        }
+        return sentences;
+    }
+};
+
+}
@@ -27,7 +27,7 @@ public:
         return std::to_string(num + 1);
     }
 
-    explicit PinyinEnglifyDB(PinyinDB &db) {
+    explicit PinyinEnglifyDB(PinyinDB const &db) {
         for (Pid pid = 0; pid < db.pinyinPidLimit(); ++pid) {
             auto chars = db.pinyinToChar(pid);
             auto pinyin = db.pinyinName(pid);
@@ -42,7 +42,7 @@ public:
         }
     }
 
-    char32_t enggyToChar(std::string const &enggy) {
+    char32_t enggyToChar(std::string const &enggy) const {
         auto it = lookupEnggyToChar.find(enggy);
         if (it != lookupEnggyToChar.end()) {
             return it->second;
@@ -50,7 +50,7 @@ public:
         return 0;
     }
 
-    std::string charToEnggy(char32_t c) {
+    std::string charToEnggy(char32_t c) const {
         auto it = lookupCharToEnggy.find(c);
         if (it != lookupCharToEnggy.end()) {
             return it->second;
@@ -58,7 +58,7 @@ public:
         return utf32toC(c);
     }
 
-    std::string charToEnggy(char32_t c, Pid pid) {
+    std::string charToEnggy(char32_t c, Pid pid) const {
         auto it = lookupCharPidToEnggy.find(std::make_pair(c, pid));
         if (it != lookupCharPidToEnggy.end()) {
             return it->second;
@@ -66,7 +66,7 @@ public:
         return charToEnggy(c);
     }
 
-    std::string enggyToString(std::string const &enggy, std::size_t *ppos = nullptr, std::size_t *dppos = nullptr) {
+    std::string enggyToString(std::string const &enggy, std::size_t *ppos = nullptr, std::size_t *dppos = nullptr) const {
         std::size_t pos, bpos, epos;
         std::string result;
         if (ppos) *ppos = 0;
@@ -84,7 +84,7 @@ public:
                 auto chunk = enggy.substr(bpos, epos != std::u32string::npos ? epos - bpos : std::u32string::npos);
                 char32_t c = enggyToChar(chunk);
                 if (c) {
-                    result.append(utf32toC(c));
+                    utf32toC(c, result);
                     if (ppos) *ppos = epos;
                     if (dppos) *dppos = result.size();
                 } else {
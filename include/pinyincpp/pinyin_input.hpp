@@ -2,6 +2,7 @@
 
 #include <cmath>
 #include <cstdint>
+#include <memory>
 #include <sstream>
 #include <algorithm>
 #include <string>
@@ -13,6 +14,8 @@
 #include <pinyincpp/sort_top_n.hpp>
 #include <pinyincpp/pinyin_words.hpp>
 #include <pinyincpp/ctype.hpp>
+#include <pinyincpp/suffix_array.hpp>
+#include <pinyincpp/ngram_table.hpp>
 
 namespace pinyincpp {
 
@@ -33,18 +36,41 @@ private:
     struct SampleString {
         std::u32string content;
         double effectivity;
+        SuffixArray index;
+        NgramTable ngrams;
+        std::uint32_t maxUnigramCount;
     };
 
-    std::vector<SampleString> sampleStrings;
+    static constexpr std::size_t kMaxPrefix = NgramTable::kMaxContext;
+    static inline const std::vector<double> kScoreTable = {0.08, 1, 4, 8, 10};
+
+    std::vector<std::shared_ptr<SampleString const>> sampleStrings; // shared by copies, which only add or drop samples
+    // sum of effectivity * log(unigram score + 1) over samples, the prefix independent part of char scores
+    std::unordered_map<char32_t, double> baseOccurance;
     double prefixEffectivity = 5.0;
+    std::size_t generation = 0;
 
 public:
     void setPrefixEffectivity(double effectivity = 1.0) {
         prefixEffectivity = effectivity;
+        ++generation;
+    }
+
+    // changes whenever the samples or their weights change, for callers caching prefixCharOccurances
+    std::size_t sampleGeneration() const noexcept {
+        return generation;
     }
 
     void addSampleString(std::u32string const &sample, double effectivity = 1.0) {
-        sampleStrings.push_back({sample, effectivity});
+        SuffixArray index(sample);
+        NgramTable ngrams(sample, index);
+        std::uint32_t maxCount = 0;
+        for (auto const &[character, count] : ngrams.unigramCounts()) {
+            baseOccurance[character] += std::log(count * kScoreTable[0] + 1) * effectivity;
+            maxCount = std::max(maxCount, count);
+        }
+        sampleStrings.push_back(std::make_shared<SampleString const>(SampleString{sample, effectivity, std::move(index), std::move(ngrams), maxCount}));
+        ++generation;
     }
 
     void addSampleString(std::string const &sample, double effectivity = 1.0) {
@@ -53,6 +79,8 @@ public:
 
     void clearSampleStrings() {
         sampleStrings.clear();
+        baseOccurance.clear();
+        ++generation;
     }
 
 private:
@@ -77,6 +105,63 @@ private:
         return occurance;
     }
 
+    // same as searchStringPostfix followed by counting next chars, but looked up in the suffix array
+    static void addPostfixOccurances(std::unordered_map<char32_t, double> &occurance,
+        SampleString const &sample, std::u32string const &postfix, std::vector<double> const &scoreTable) {
+        if (postfix.empty()) [[unlikely]] {
+            return;
+        }
+        auto const &text = sample.content;
+        auto tableScore = [&] (std::size_t num) {
+            return scoreTable[std::min(num, scoreTable.size() - 1)];
+        };
+        bool overlapping = false;
+        for (std::size_t num = 1; num <= postfix.size(); ++num) {
+            overlapping = overlapping || SuffixArray::selfOverlapping(std::u32string_view(postfix).substr(postfix.size() - num));
+        }
+        if (overlapping) {
+            // occurrences skip each other like in searchStringPostfix, so resolve them one by one
+            std::unordered_map<std::size_t, std::size_t> matches;
+            std::vector<std::size_t> positions;
+            for (std::size_t num = 1; num <= postfix.size(); ++num) {
+                sample.index.findOccurances(text, std::u32string_view(postfix).substr(postfix.size() - num), positions);
+                for (std::size_t pos : positions) {
+                    matches.insert_or_assign(pos + num, num);
+                }
+            }
+            for (auto const &[match, count] : matches) {
+                if (count && match < text.size()) {
+                    occurance[text[match]] += tableScore(count);
+                }
+            }
+            return;
+        }
+        // every occurrence of a longer postfix ends where a shorter one does, so each end position scores
+        // with the longest postfix: count(postfix[num] + c) - count(postfix[num + 1] + c)
+        for (std::size_t num = 1; num <= postfix.size(); ++num) {
+            auto p = std::u32string_view(postfix).substr(postfix.size() - num);
+            double delta = tableScore(num);
+            if (num > 1) {
+                delta -= tableScore(num - 1);
+            }
+            bool found = false;
+            auto visit = [&] (char32_t c, std::size_t count) {
+                found = true;
+                occurance[c] += delta * count;
+            };
+            if (num <= NgramTable::kMaxContext) {
+                for (auto const &next : sample.ngrams.next(p)) {
+                    visit(next.character, next.count);
+                }
+            } else {
+                sample.index.visitNextChars(text, p, visit);
+            }
+            if (!found) {
+                break;
+            }
+        }
+    }
+
     static std::unordered_map<char32_t, double> charOccurances(
         std::u32string const &sample, std::u32string const &prefix, std::vector<double> const &scoreTable) {
         std::unordered_map<char32_t, double> occurance;
@@ -103,6 +188,31 @@ private:
         return occurance;
     }
 
+    static void mulScoreWordOccurances(std::vector<WordCandidate> &words, double effectivity,
+        SampleString const &sampleString, std::u32string const &prefix, std::vector<double> const &scoreTable) {
+        auto const &sample = sampleString.content;
+        if (sample.empty() || scoreTable.empty()) [[unlikely]] {
+            return;
+        }
+        auto maxScore = std::min(prefix.size(), scoreTable.size());
+        std::vector<std::size_t> positions;
+        for (auto &word : words) {
+            double count = 0;
+            sampleString.index.findOccurances(sample, word.word, positions);
+            for (std::size_t pos : positions) {
+                std::size_t s = 0;
+                for (; s < std::min(maxScore, pos + 1); ++s) {
+                    if (prefix[prefix.size() - 1 - s] == sample[pos - s]) {
+                        break;
+                    }
+                }
+                count += scoreTable[std::min(s, scoreTable.size())];
+            }
+            auto logProb = std::log(count + 1);
+            word.score += effectivity * logProb;
+        }
+    }
+
     static void mulScoreWordOccurances(std::vector<WordCandidate> &words, double effectivity,
         std::u32string const &sample, std::u32string const &prefix, std::vector<double> const &scoreTable) {
         std::vector<double> occurance(words.size());
@@ -128,33 +238,72 @@ private:
         }
     }
 
-    std::unordered_map<char32_t, double> suggestCharCandidatesMap(std::u32string const &prefix) {
-        std::u32string lastPrefix;
-        std::u32string beforePrefix;
-        constexpr std::size_t kMaxPrefix = 4;
+private:
+    static std::pair<std::u32string, std::u32string> splitPrefix(std::u32string const &prefix) {
         if (prefix.size() > kMaxPrefix) {
-            lastPrefix = prefix.substr(prefix.size() - kMaxPrefix);
-            beforePrefix = prefix.substr(0, prefix.size() - kMaxPrefix + 1);
-        } else {
-            lastPrefix = prefix;
+            return {prefix.substr(prefix.size() - kMaxPrefix), prefix.substr(0, prefix.size() - kMaxPrefix + 1)};
         }
+        return {prefix, {}};
+    }
+
+public:
+    double baseCharOccurance(char32_t character) const {
+        auto it = baseOccurance.find(character);
+        return it == baseOccurance.end() ? 0 : it->second;
+    }
+
+public:
+    // scores of the chars that depend on prefix, any other char scores baseCharOccurance,
+    // only the n-gram table entries of the prefix context are looked up
+    std::unordered_map<char32_t, double> prefixCharOccurances(std::u32string const &prefix) const {
+        auto [lastPrefix, beforePrefix] = splitPrefix(prefix);
         std::unordered_map<char32_t, double> occurance;
-        const std::vector<double> scoreTable = {0.08, 1, 4, 8, 10};
-        for (auto const &sample: sampleStrings) {
-            for (auto const &[character, logProb]: charOccurances(sample.content, lastPrefix, scoreTable)) {
-                occurance[character] += logProb * sample.effectivity;
+        if (!lastPrefix.empty()) {
+            std::vector<std::unordered_map<char32_t, double>> contexts(sampleStrings.size());
+            for (std::size_t i = 0; i < sampleStrings.size(); ++i) {
+                addPostfixOccurances(contexts[i], *sampleStrings[i], lastPrefix, kScoreTable);
+                for (auto const &[character, score] : contexts[i]) {
+                    occurance.try_emplace(character, 0.0);
+                }
+            }
+            for (auto &[character, logProb] : occurance) {
+                for (std::size_t i = 0; i < sampleStrings.size(); ++i) {
+                    auto const &sample = *sampleStrings[i];
+                    auto count = sample.ngrams.unigramCount(character);
+                    if (!count) {
+                        continue;
+                    }
+                    double score = count * kScoreTable[0];
+                    if (auto it = contexts[i].find(character); it != contexts[i].end()) {
+                        score += it->second;
+                    }
+                    logProb += std::log(score + 1) * sample.effectivity;
+                }
             }
         }
         if (!beforePrefix.empty()) {
-            for (auto const &[character, logProb]: charOccurances(beforePrefix, lastPrefix, scoreTable)) {
-                occurance[character] += logProb * prefixEffectivity;
+            for (auto const &[character, logProb]: charOccurances(beforePrefix, lastPrefix, kScoreTable)) {
+                auto it = occurance.find(character);
+                if (it == occurance.end()) {
+                    it = occurance.emplace(character, baseCharOccurance(character)).first;
+                }
+                it->second += logProb * prefixEffectivity;
             }
         }
         return occurance;
     }
 
+private:
+    std::unordered_map<char32_t, double> suggestCharCandidatesMap(std::u32string const &prefix) const {
+        auto occurance = prefixCharOccurances(prefix);
+        for (auto const &[character, logProb] : baseOccurance) {
+            occurance.try_emplace(character, logProb);
+        }
+        return occurance;
+    }
+
 public:
-    std::vector<CharCandidate> suggestCharCandidates(std::u32string const &prefix, std::size_t numResults = 100, bool chineseOnly = true) {
+    std::vector<CharCandidate> suggestCharCandidates(std::u32string const &prefix, std::size_t numResults = 100, bool chineseOnly = true) const {
         std::vector<CharCandidate> candidates;
         auto occurance = suggestCharCandidatesMap(prefix);
         for (auto const &[character, logProb] : occurance) {
@@ -166,54 +315,85 @@ public:
         return candidates;
     }
 
-    std::vector<WordCandidate> pinyinWordCandidates(PinyinDB &db, PinyinWordsDB &wd, std::u32string const &prefix, std::vector<Pid> const &pids, std::size_t numResults = 100, std::size_t depthLimit = 2) {
+    std::vector<WordCandidate> pinyinWordCandidates(PinyinDB const &db, PinyinWordsDB const &wd, std::u32string const &prefix, std::vector<Pid> const &pids, std::size_t numResults = 100, std::size_t depthLimit = 2) const {
+        TrieWalk<PinyinWordsDB, Pid> walk(wd);
+        walk.walk(pids);
+        return pinyinWordCandidates(db, wd, prefix, walk, numResults, depthLimit);
+    }
+
+    // same as above with the pids already walked down the word tries, words are visited best first by their
+    // dictionary score and only converted and matched against the samples until the rest cannot make the top
+    std::vector<WordCandidate> pinyinWordCandidates(PinyinDB const &db, PinyinWordsDB const &wd, std::u32string const &prefix, TrieWalk<PinyinWordsDB, Pid> const &walk, std::size_t numResults = 100, std::size_t depthLimit = 2) const {
         std::vector<WordCandidate> candidates;
-        if (!pids.empty()) {
-            wd.triePinyinToWord.visitPrefix(pids, [&] (std::vector<Pid> const &fullPids, std::size_t const &wordIndex) {
-                auto const &w = wd.wordData[wordIndex];
-                candidates.push_back({w.score * pids.size() / (fullPids.size() + 1), utf16to32(w.word), fullPids});
-                return false;
-            }, depthLimit);
-        } else {
-            wd.triePinyinToWord.visitItems<std::vector<Pid>>([&] (std::vector<Pid> const &fullPids, std::size_t const &wordIndex) {
-                auto const &w = wd.wordData[wordIndex];
-                candidates.push_back({w.score * pids.size() / (fullPids.size() + 1), utf16to32(w.word), fullPids});
-                return false;
-            }, depthLimit);
-        }
-        std::u32string lastPrefix;
-        std::u32string beforePrefix;
-        constexpr std::size_t kMaxPrefix = 4;
-        if (prefix.size() > kMaxPrefix) {
-            lastPrefix = prefix.substr(prefix.size() - kMaxPrefix);
-            beforePrefix = prefix.substr(0, prefix.size() - kMaxPrefix + 1);
-        } else {
-            lastPrefix = prefix;
+        if (!numResults) [[unlikely]] {
+            return candidates;
         }
-        const std::vector<double> scoreTable = {0.08, 1, 4, 8, 10};
+        auto numPids = walk.depth();
+        auto [lastPrefix, beforePrefix] = splitPrefix(prefix);
+        // the most occurances can add to a score, a word occurs at most as often as its first char
+        double maxTableScore = *std::max_element(kScoreTable.begin(), kScoreTable.end());
+        double maxBonus = 0;
         for (auto const &sample: sampleStrings) {
-            mulScoreWordOccurances(candidates, sample.effectivity, sample.content, lastPrefix, scoreTable);
+            maxBonus += std::max(sample->effectivity, 0.0) * std::log(sample->maxUnigramCount * maxTableScore + 1);
         }
         if (!beforePrefix.empty()) {
-            mulScoreWordOccurances(candidates, prefixEffectivity, beforePrefix, lastPrefix, scoreTable);
+            maxBonus += std::max(prefixEffectivity, 0.0) * std::log(beforePrefix.size() * maxTableScore + 1);
+        }
+        // heap with the worst kept word on top, ties kept in visit order
+        std::vector<std::pair<WordCandidate, std::size_t>> kept;
+        auto better = [] (auto const &a, auto const &b) {
+            return a.first.score != b.first.score ? a.first.score > b.first.score : a.second < b.second;
+        };
+        std::vector<WordCandidate> scored(1);
+        std::size_t numVisited = 0;
+        auto bound = [&] (float score, std::size_t depth) {
+            return std::max(score, 0.0f) * numPids / (numPids + depth + 1);
+        };
+        wd.visitBestFirst(walk.cursor(), walk.path(), bound, [&] (double key, std::size_t wordIndex, std::size_t depth, auto &&pinyin) {
+            // small slack as the bonus is a sum of rounded logs
+            if (kept.size() >= numResults && key + maxBonus + 1e-9 < kept.front().first.score) {
+                return true;
+            }
+            auto w = wd.wordData[wordIndex];
+            auto &word = scored.front();
+            word.score = w.score * numPids / (numPids + depth + 1);
+            word.word = utf16to32(w.word);
+            for (auto const &sample: sampleStrings) {
+                mulScoreWordOccurances(scored, sample->effectivity, *sample, lastPrefix, kScoreTable);
+            }
+            if (!beforePrefix.empty()) {
+                mulScoreWordOccurances(scored, prefixEffectivity, beforePrefix, lastPrefix, kScoreTable);
+            }
+            auto order = numVisited++;
+            if (kept.size() < numResults) {
+                word.pinyin = pinyin();
+                kept.emplace_back(std::move(word), order);
+                std::push_heap(kept.begin(), kept.end(), better);
+            } else if (word.score > kept.front().first.score) {
+                word.pinyin = pinyin();
+                std::pop_heap(kept.begin(), kept.end(), better);
+                kept.back() = {std::move(word), order};
+                std::push_heap(kept.begin(), kept.end(), better);
+            }
+            return false;
+        }, depthLimit);
+        std::sort_heap(kept.begin(), kept.end(), better);
+        candidates.reserve(kept.size());
+        for (auto &[word, order] : kept) {
+            candidates.push_back(std::move(word));
         }
-        /* std::erase_if(candidates, [](WordCandidate const &a) { */
-        /*     return a.score <= 0; */
-        /* }); */
-        sortTopN(candidates, numResults, &WordCandidate::score);
         return candidates;
     }
 
-    std::vector<CharCandidate> pinyinCharCandidates(PinyinDB &db, std::u32string const &prefix, Pid pid, std::size_t numResults = 100) {
-        auto occurance = suggestCharCandidatesMap(prefix);
+    std::vector<CharCandidate> pinyinCharCandidates(PinyinDB const &db, std::u32string const &prefix, Pid pid, std::size_t numResults = 100) const {
+        return pinyinCharCandidates(db, prefixCharOccurances(prefix), pid, numResults);
+    }
+
+    // same as above with the prefixCharOccurances of the prefix already computed
+    std::vector<CharCandidate> pinyinCharCandidates(PinyinDB const &db, std::unordered_map<char32_t, double> const &occurance, Pid pid, std::size_t numResults = 100) const {
         auto charProbability = [&](char32_t character) -> double {
             auto it = occurance.find(character);
-            double logProb = 0;
-            if (it != occurance.end()) {
-                logProb = it->second;
-                occurance.erase(it);
-            }
-            return logProb;
+            return it != occurance.end() ? it->second : baseCharOccurance(character);
         };
         std::vector<CharCandidate> candidates;
         if (pid < 0) {
@@ -0,0 +1,357 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <pinyincpp/pinyin_chars.hpp>
+#include <pinyincpp/pinyin_words.hpp>
+
+namespace pinyincpp {
+
+struct KBestPath {
+    std::vector<std::uint32_t> edges; // indices of the edges along the path, from node 0
+    double score;
+};
+
+// the k best scored distinct label sequences over the paths from node 0 to node n of a DAG, k-best viterbi
+// keeping beamWidth entries per node; edges are sorted by end and have begin, end and score, labels(edge,
+// visit) calls visit on each integral label of edge in order; of the paths spelling the same labels only the
+// best is kept, equal label hashes are confirmed by comparing the labels, so a collision drops nothing
+template <class Label, class Edge, class Labels>
+std::vector<KBestPath> kBestPaths(std::span<Edge const> edges, std::size_t n, std::size_t k, std::size_t beamWidth, Labels &&labels) {
+    struct Entry {
+        double score;
+        std::uint32_t edge;
+        std::uint32_t prevRank;
+        std::uint64_t hash;
+    };
+    std::vector<KBestPath> paths;
+    if (!k || !beamWidth) [[unlikely]] {
+        return paths;
+    }
+    std::vector<std::vector<Entry>> best(n + 1);
+    best[0].push_back({0.0, (std::uint32_t)-1, 0, 0xcbf29ce484222325ull});
+    // labels of the path ending with entry, last first
+    auto reversedLabels = [&] (Entry const *entry, std::vector<Label> &out) {
+        out.clear();
+        while (entry->edge != (std::uint32_t)-1) {
+            auto const &edge = edges[entry->edge];
+            auto first = out.size();
+            labels(edge, [&] (Label const &label) { out.push_back(label); });
+            std::reverse(out.begin() + first, out.end());
+            entry = &best[edge.begin][entry->prevRank];
+        }
+    };
+    std::vector<Label> lhs, rhs;
+    std::vector<Entry> candidates;
+    std::size_t e = 0;
+    for (std::size_t v = 1; v <= n; ++v) {
+        candidates.clear();
+        for (; e < edges.size() && edges[e].end == v; ++e) {
+            auto const &edge = edges[e];
+            auto const &from = best[edge.begin];
+            for (std::uint32_t r = 0; r < from.size(); ++r) {
+                auto hash = from[r].hash;
+                labels(edge, [&] (Label const &label) {
+                    hash = (hash ^ static_cast<std::uint64_t>(label)) * 0x100000001b3ull;
+                });
+                candidates.push_back({from[r].score + edge.score, static_cast<std::uint32_t>(e), r, hash});
+            }
+        }
+        std::stable_sort(candidates.begin(), candidates.end(), [] (Entry const &a, Entry const &b) {
+            return a.score > b.score;
+        });
+        auto &entries = best[v];
+        for (auto const &c : candidates) {
+            if (entries.size() >= beamWidth) {
+                break;
+            }
+            bool duplicate = false;
+            for (auto const &x : entries) {
+                if (x.hash == c.hash) {
+                    reversedLabels(&c, lhs);
+                    reversedLabels(&x, rhs);
+                    if (lhs == rhs) {
+                        duplicate = true;
+                        break;
+                    }
+                }
+            }
+            if (!duplicate) {
+                entries.push_back(c);
+            }
+        }
+    }
+    for (std::uint32_t r = 0; r < best[n].size() && r < k; ++r) {
+        auto &path = paths.emplace_back();
+        path.score = best[n][r].score;
+        for (auto const *entry = &best[n][r]; entry->edge != (std::uint32_t)-1; entry = &best[edges[entry->edge].begin][entry->prevRank]) {
+            path.edges.push_back(entry->edge);
+        }
+        std::reverse(path.edges.begin(), path.edges.end());
+    }
+    return paths;
+}
+
+// every segmentation of a pinyin input as a DAG over input positions: an edge per syllable the
+// automaton accepts at each position, a special edge per char, an empty edge per separator, and
+// an edge per run of syllables spelling a dictionary word, which carries the word score as a bonus;
+// update() rebuilds only the edges of the positions whose syllables or words read a changed char,
+// so a lattice kept across keystrokes costs about the change, as pinyinSplit checkpoints do
+struct PinyinLattice {
+    static constexpr double kSyllablePenalty = 8.0; // per syllable, so fewer and longer syllables are preferred
+    static constexpr double kSpecialPenalty = 16.0; // per char that is not part of a syllable
+    static constexpr double kWordWeight = 1.0;
+    static constexpr std::size_t kMaxWordSyllables = 8;
+
+    struct Edge {
+        std::uint32_t begin;
+        std::uint32_t end;
+        std::uint32_t firstPid; // range into pids and pidEnds
+        std::uint32_t numPids;
+        double score;
+    };
+
+    struct Path {
+        std::vector<Pid> pids;
+        std::vector<std::size_t> indices; // end position of each pid, as in pinyinSplit
+        double score;
+    };
+
+private:
+    struct Syllable {
+        Pid pid;
+        std::uint32_t end;
+        double score;
+    };
+
+    bool ignoreCase = false;
+    char32_t sepChar = U' ';
+    std::u32string text;
+    std::size_t length = 0;
+    // per position: whether it is a separator, the syllables starting there, and one past the last char
+    // read to find them or the words starting there, length + 1 if the end of the input was reached
+    std::vector<bool> separator;
+    std::vector<std::vector<Syllable>> syllablesFrom;
+    std::vector<std::uint32_t> syllableReach;
+    std::vector<std::uint32_t> reachMax; // running max of the reach of words and syllables up to each position
+    std::vector<Edge> beginEdges;        // sorted by begin
+    std::vector<std::uint32_t> beginOffsets;
+    std::vector<Edge> edgeList;          // sorted by end
+    std::vector<Pid> pids;
+    std::vector<std::uint32_t> pidEnds;
+    std::vector<std::uint32_t> endOffsets; // length + 2 offsets into edgeList by end
+    std::unordered_map<Pid, double> syllableScores;
+
+    std::uint32_t addEdge(std::size_t begin, std::size_t end, double score) {
+        beginEdges.push_back({static_cast<std::uint32_t>(begin), static_cast<std::uint32_t>(end), static_cast<std::uint32_t>(pids.size()), 0, score});
+        return beginEdges.size() - 1;
+    }
+
+    double syllableScore(PinyinDB const &db, Pid pid) {
+        auto [it, success] = syllableScores.try_emplace(pid, 0.0);
+        if (success) {
+            double best = 0;
+            for (auto const &c : db.pinyinToChar(pid)) {
+                best = std::max(best, (double)c.logFrequency);
+            }
+            it->second = best - kSyllablePenalty;
+        }
+        return it->second;
+    }
+
+    // extend runs of syllables (separators allowed in between) while some word still has them as prefix,
+    // returns the reach of the chars read
+    std::uint32_t addWordEdges(PinyinWordsDB const &wd, std::size_t begin) {
+        std::uint32_t reach = begin + 1;
+        std::vector<Pid> run;
+        std::vector<std::uint32_t> runEnds;
+        auto extend = [&] (auto &&self, std::size_t node, PinyinWordsDB::Cursor cursor, double score) -> void {
+            while (node < length && separator[node]) {
+                reach = std::max<std::uint32_t>(reach, node + 1);
+                ++node;
+            }
+            reach = std::max<std::uint32_t>(reach, node < length ? syllableReach[node] : length + 1);
+            if (run.size() >= kMaxWordSyllables || node >= length) {
+                return;
+            }
+            for (auto const &syllable : syllablesFrom[node]) {
+                run.push_back(syllable.pid);
+                runEnds.push_back(syllable.end);
+                if (auto next = wd.advance(cursor, run.back())) {
+                    double s = score + syllable.score;
+                    if (run.size() >= 2) {
+                        double best = -std::numeric_limits<double>::infinity();
+                        wd.visitItems(next, run, [&] (std::vector<Pid> const &, std::size_t const &wordIndex) {
+                            best = std::max(best, (double)wd.wordData.score(wordIndex));
+                            return false;
+                        }, 1);
+                        if (best != -std::numeric_limits<double>::infinity()) {
+                            auto e = addEdge(begin, syllable.end, s + kWordWeight * best);
+                            pids.insert(pids.end(), run.begin(), run.end());
+                            pidEnds.insert(pidEnds.end(), runEnds.begin(), runEnds.end());
+                            beginEdges[e].numPids = run.size();
+                        }
+                    }
+                    self(self, syllable.end, next, s);
+                }
+                run.pop_back();
+                runEnds.pop_back();
+            }
+        };
+        extend(extend, begin, wd.cursor(), 0.0);
+        return reach;
+    }
+
+public:
+    PinyinLattice() : PinyinLattice(false) {}
+
+    // an empty lattice to be filled by update
+    explicit PinyinLattice(bool ignoreCase, char32_t sepChar = U' ')
+    : ignoreCase(ignoreCase), sepChar(sepChar), endOffsets(2, 0) {}
+
+    // wd may be null to score syllables by char frequencies only
+    PinyinLattice(PinyinDB const &db, PinyinWordsDB const *wd, std::u32string_view input,
+                  bool ignoreCase = false, char32_t sepChar = U' ')
+    : PinyinLattice(ignoreCase, sepChar) {
+        update(db, wd, input);
+    }
+
+    // the lattice of input, keeping the edges of the positions that read no char from the first one
+    // differing from the last input on; db and wd must be the ones of the previous updates
+    void update(PinyinDB const &db, PinyinWordsDB const *wd, std::u32string_view input) {
+        auto common = static_cast<std::size_t>(std::mismatch(input.begin(), input.end(), text.begin(), text.end()).first - input.begin());
+        if (common == input.size() && common == text.size()) {
+            return;
+        }
+        // the first position that read a char at or after common, the running max makes it a binary search
+        auto keep = static_cast<std::size_t>(std::upper_bound(reachMax.begin(), reachMax.end(), common) - reachMax.begin());
+        keep = std::min(keep, common);
+        text.assign(input);
+        length = text.size();
+        separator.resize(keep);
+        syllablesFrom.resize(keep);
+        syllableReach.resize(keep);
+        reachMax.resize(keep);
+        std::size_t keepEdges = keep < beginOffsets.size() ? beginOffsets[keep] : beginEdges.size();
+        if (keepEdges < beginEdges.size()) {
+            pids.resize(beginEdges[keepEdges].firstPid);
+            pidEnds.resize(beginEdges[keepEdges].firstPid);
+        }
+        beginEdges.resize(keepEdges);
+        beginOffsets.resize(keep);
+
+        for (std::size_t i = keep; i < length; ++i) {
+            auto &syllables = syllablesFrom.emplace_back();
+            separator.push_back(text[i] == sepChar);
+            if (separator.back()) {
+                syllableReach.push_back(i + 1);
+                continue;
+            }
+            std::uint32_t state = 0;
+            std::size_t j = i;
+            for (; j < length && (state = db.snapshotView().syllableNext(state, text[j])); ++j) {
+                Pid pid = db.snapshotView().syllableState(state).pid;
+                if (pid >= 0) {
+                    syllables.push_back({pid, static_cast<std::uint32_t>(j + 1), syllableScore(db, pid)});
+                }
+            }
+            syllableReach.push_back(j < length ? j + 1 : length + 1);
+        }
+        for (std::size_t i = keep; i < length; ++i) {
+            beginOffsets.push_back(beginEdges.size());
+            std::uint32_t reach = syllableReach[i];
+            if (separator[i]) {
+                addEdge(i, i + 1, 0);
+            } else {
+                auto c = text[i];
+                if (ignoreCase && 'A' <= c && c <= 'Z') {
+                    c += 'a' - 'A';
+                }
+                auto e = addEdge(i, i + 1, -kSpecialPenalty);
+                pids.push_back(makeSpecialPid(c));
+                pidEnds.push_back(i + 1);
+                beginEdges[e].numPids = 1;
+                for (auto const &syllable : syllablesFrom[i]) {
+                    auto e = addEdge(i, syllable.end, syllable.score);
+                    pids.push_back(syllable.pid);
+                    pidEnds.push_back(syllable.end);
+                    beginEdges[e].numPids = 1;
+                }
+                if (wd) {
+                    reach = std::max(reach, addWordEdges(*wd, i));
+                }
+            }
+            reachMax.push_back(std::max(reach, reachMax.empty() ? 0 : reachMax.back()));
+        }
+
+        // counting sort by end, stable so edges ending together keep their order by begin
+        endOffsets.assign(length + 2, 0);
+        for (auto const &e : beginEdges) {
+            ++endOffsets[e.end + 1];
+        }
+        for (std::size_t v = 1; v < endOffsets.size(); ++v) {
+            endOffsets[v] += endOffsets[v - 1];
+        }
+        edgeList.resize(beginEdges.size());
+        auto next = endOffsets;
+        for (auto const &e : beginEdges) {
+            edgeList[next[e.end]++] = e;
+        }
+    }
+
+    std::size_t size() const noexcept {
+        return length;
+    }
+
+    std::span<Edge const> edges() const noexcept {
+        return edgeList;
+    }
+
+    // edges ending at position end
+    std::span<Edge const> edgesTo(std::size_t end) const noexcept {
+        return std::span<Edge const>(edgeList).subspan(endOffsets[end], endOffsets[end + 1] - endOffsets[end]);
+    }
+
+    std::span<Pid const> edgePids(Edge const &edge) const noexcept {
+        return {pids.data() + edge.firstPid, edge.numPids};
+    }
+
+    std::span<std::uint32_t const> edgePidEnds(Edge const &edge) const noexcept {
+        return {pidEnds.data() + edge.firstPid, edge.numPids};
+    }
+
+    // the k best scored distinct pid sequences covering the whole input, a pid sequence reachable by several
+    // edge paths (e.g. with and without a word edge) keeps its best
+    std::vector<Path> kBest(std::size_t k) const {
+        std::vector<Path> paths;
+        auto found = kBestPaths<Pid>(edges(), length, k, k, [this] (Edge const &edge, auto &&visit) {
+            for (Pid pid : edgePids(edge)) {
+                visit(pid);
+            }
+        });
+        for (auto const &f : found) {
+            auto &path = paths.emplace_back();
+            path.score = f.score;
+            for (auto e : f.edges) {
+                auto edgeP = edgePids(edgeList[e]);
+                auto edgeE = edgePidEnds(edgeList[e]);
+                path.pids.insert(path.pids.end(), edgeP.begin(), edgeP.end());
+                path.indices.insert(path.indices.end(), edgeE.begin(), edgeE.end());
+            }
+        }
+        return paths;
+    }
+
+    Path bestPath() const {
+        auto paths = kBest(1);
+        return paths.empty() ? Path{{}, {}, 0.0} : std::move(paths.front());
+    }
+};
+
+}
@@ -2,89 +2,35 @@
 
 #include <cmath>
 #include <cstdint>
+#include <span>
 #include <sstream>
 #include <algorithm>
+#include <iterator>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <pinyincpp/utf8.hpp>
 #include <pinyincpp/sort_top_n.hpp>
 #include <pinyincpp/pinyin_chars.hpp>
+#include <pinyincpp/bit_lcs.hpp>
+#include <pinyincpp/work_stealing.hpp>
+#include <pinyincpp/pid_signature.hpp>
 
 namespace pinyincpp {
 
 struct PinyinMatch {
     static std::vector<std::size_t> matchPinyin(std::vector<PidSet> const &p1, std::vector<Pid> const &p2) {
-        // find max sub-sequence length
-        std::size_t l1 = p1.size();
-        std::size_t l2 = p2.size();
-        std::vector<std::size_t> dp((l1 + 1) * (l2 + 1));
-        for (std::size_t i = 0; i < l1; ++i) {
-            std::size_t *dp0 = dp.data() + i * (l2 + 1);
-            std::size_t *dp1 = dp0 + (l2 + 1);
-            for (std::size_t j = 0; j < l2; ++j) {
-                if (std::find(p1[i].begin(), p1[i].end(), p2[j]) != p1[i].end()) {
-                    dp1[j + 1] = dp0[j] + 1;
-                } else {
-                    dp1[j + 1] = std::max(dp0[j + 1], dp1[j]);
-                }
-            }
-        }
-        // trace back to get matches
-        std::size_t i = l1, j = l2;
-        std::vector<std::size_t> matches;
-        while (i > 0 && j > 0) {
-            const std::size_t *dp1 = dp.data() + (i - 1) * (l2 + 1);
-            const std::size_t *dp0 = dp1 + (l2 + 1);
-            if (dp0[j] == dp1[j]) {
-                --i;
-            } else if (dp0[j] == dp0[j - 1]) {
-                --j;
-            } else {
-                matches.push_back(i - 1);
-                --i;
-                --j;
-            }
-        }
-        std::reverse(matches.begin(), matches.end());
-        return matches;
+        BitLcs<Pid> lcs(p2);
+        lcs.run(p1);
+        return lcs.traceback();
     }
 
     static std::vector<std::size_t> matchString(std::u32string const &s1, std::u32string const &s2) {
-        // find max sub-sequence length
-        std::size_t l1 = s1.size();
-        std::size_t l2 = s2.size();
-        std::vector<std::size_t> dp((l1 + 1) * (l2 + 1));
-        for (std::size_t i = 0; i < l1; ++i) {
-            std::size_t *dp0 = dp.data() + i * (l2 + 1);
-            std::size_t *dp1 = dp0 + (l2 + 1);
-            for (std::size_t j = 0; j < l2; ++j) {
-                if (s1[i] == s2[j]) {
-                    dp1[j + 1] = dp0[j] + 1;
-                } else {
-                    dp1[j + 1] = std::max(dp0[j + 1], dp1[j]);
-                }
-            }
-        }
-        // trace back to get matches
-        std::size_t i = l1, j = l2;
-        std::vector<std::size_t> matches;
-        while (i > 0 && j > 0) {
-            const std::size_t *dp1 = dp.data() + (i - 1) * (l2 + 1);
-            const std::size_t *dp0 = dp1 + (l2 + 1);
-            if (dp0[j] == dp1[j]) {
-                --i;
-            } else if (dp0[j] == dp0[j - 1]) {
-                --j;
-            } else {
-                matches.push_back(i - 1);
-                --i;
-                --j;
-            }
-        }
-        std::reverse(matches.begin(), matches.end());
-        return matches;
+        BitLcs<char32_t> lcs(s2);
+        lcs.run(s1);
+        return lcs.traceback();
     }
 
     static double matchScore(std::vector<std::size_t> const &matches, std::size_t targetLen, std::size_t expectSize) {
@@ -110,25 +56,163 @@ struct PinyinMatch {
         return 1.0 / sumDiff;
     }
 
+    // upper bound of matchScore over all matches of the given length: the gaps sum up to at least
+    // back - front, so sumDiff >= 1 + targetLen + (expectSize - matchLen + 1)^2
+    static double matchScoreBound(std::size_t matchLen, std::size_t targetLen, std::size_t expectSize) {
+        if (!matchLen) [[unlikely]] return 0;
+        std::uint32_t sumDiff = 1;
+        if (targetLen && expectSize) {
+            std::uint32_t delta = expectSize - matchLen + 1;
+            sumDiff += delta * delta;
+            sumDiff += targetLen;
+        }
+        return 1.0 / sumDiff;
+    }
+
     struct MatchResult {
         std::size_t index;
         double score;
         std::vector<std::size_t> highlights;
     };
 
+    // candidates whose signature has fewer than minMatches of the query pids are skipped before the lcs,
+    // minMatches <= 1 only skips candidates that cannot match at all, higher values trade recall for speed
+    struct Prefilter {
+        std::span<PidSignature const> signatures; // one per candidate, empty to disable
+        std::size_t minMatches = 1;
+
+        bool prune(std::size_t i, std::vector<Pid> const &p2) const noexcept {
+            return !signatures.empty() && signatures[i].possibleMatches(p2) < minMatches;
+        }
+    };
+
+    struct MatchStats {
+        std::size_t numCandidates = 0;
+        std::size_t numPruned = 0;
+    };
+
+    // order of top N results: by score, then by index
+    static bool betterMatch(MatchResult const &a, MatchResult const &b) {
+        return a.score != b.score ? a.score > b.score : a.index < b.index;
+    }
+
+    // push into a heap of at most numResults with the worst kept result on top
+    static void keepTopN(std::vector<MatchResult> &heap, std::size_t numResults, MatchResult &&m) {
+        if (heap.size() < numResults) {
+            heap.push_back(std::move(m));
+            std::push_heap(heap.begin(), heap.end(), betterMatch);
+        } else if (betterMatch(m, heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), betterMatch);
+            heap.back() = std::move(m);
+            std::push_heap(heap.begin(), heap.end(), betterMatch);
+        }
+    }
+
     static std::vector<MatchResult> batchedMatchPinyin(std::vector<std::vector<PidSet>> const &p1s, std::vector<Pid> const &p2) {
         std::vector<MatchResult> matches;
+        BitLcs<Pid> lcs(p2);
         for (std::size_t i = 0; i < p1s.size(); ++i) {
-            auto highlights = matchPinyin(p1s[i], p2);
+            if (!lcs.run(p1s[i])) {
+                continue;
+            }
+            auto highlights = lcs.traceback();
             double score = matchScore(highlights, p1s[i].size(), p2.size());
             if (score > 0) [[likely]] {
-                matches.push_back({i, score, highlights});
+                matches.push_back({i, score, std::move(highlights)});
+            }
+        }
+        return matches;
+    }
+
+    // best numResults matches ordered by score then index, only candidates whose score bound
+    // can still beat the kept results are traced back
+    static std::vector<MatchResult> batchedMatchPinyin(std::vector<std::vector<PidSet>> const &p1s, std::vector<Pid> const &p2, std::size_t numResults,
+        Prefilter const *prefilter = nullptr, MatchStats *stats = nullptr) {
+        std::vector<MatchResult> matches;
+        if (stats) {
+            *stats = {p1s.size(), 0};
+        }
+        if (!numResults) [[unlikely]] {
+            return matches;
+        }
+        BitLcs<Pid> lcs(p2);
+        std::vector<std::pair<double, std::size_t>> bounds;
+        for (std::size_t i = 0; i < p1s.size(); ++i) {
+            if (prefilter && prefilter->prune(i, p2)) {
+                if (stats) {
+                    ++stats->numPruned;
+                }
+                continue;
+            }
+            if (auto len = lcs.run(p1s[i])) {
+                bounds.emplace_back(matchScoreBound(len, p1s[i].size(), p2.size()), i);
+            }
+        }
+        std::sort(bounds.begin(), bounds.end(), [] (auto const &a, auto const &b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+        for (auto const &[bound, i] : bounds) {
+            if (matches.size() >= numResults && bound < matches.front().score) {
+                break;
+            }
+            lcs.run(p1s[i]);
+            auto highlights = lcs.traceback();
+            keepTopN(matches, numResults, {i, matchScore(highlights, p1s[i].size(), p2.size()), std::move(highlights)});
+        }
+        std::sort_heap(matches.begin(), matches.end(), betterMatch);
+        return matches;
+    }
+
+    // same results as batchedMatchPinyin(p1s, p2, numResults), chunks of candidates are scheduled on
+    // numThreads workers with work stealing, each worker keeps its own top N and the heaps are merged
+    static std::vector<MatchResult> parallelBatchedMatchPinyin(std::vector<std::vector<PidSet>> const &p1s, std::vector<Pid> const &p2,
+        std::size_t numResults = (std::size_t)-1, std::size_t numThreads = 0, std::size_t chunkSize = 1024,
+        Prefilter const *prefilter = nullptr, MatchStats *stats = nullptr) {
+        std::vector<MatchResult> matches;
+        if (stats) {
+            *stats = {p1s.size(), 0};
+        }
+        if (!numResults) [[unlikely]] {
+            return matches;
+        }
+        if (!numThreads) {
+            numThreads = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+        }
+        std::vector<std::vector<MatchResult>> heaps(numThreads);
+        std::vector<BitLcs<Pid>> lcss(numThreads, BitLcs<Pid>(p2));
+        std::vector<std::size_t> numPruned(numThreads);
+        workStealingFor(p1s.size(), chunkSize, numThreads, [&] (std::size_t worker, std::size_t, std::size_t begin, std::size_t end) {
+            auto &heap = heaps[worker];
+            auto &lcs = lcss[worker];
+            for (std::size_t i = begin; i < end; ++i) {
+                if (prefilter && prefilter->prune(i, p2)) {
+                    ++numPruned[worker];
+                    continue;
+                }
+                auto len = lcs.run(p1s[i]);
+                if (!len || (heap.size() >= numResults && matchScoreBound(len, p1s[i].size(), p2.size()) < heap.front().score)) {
+                    continue;
+                }
+                auto highlights = lcs.traceback();
+                keepTopN(heap, numResults, {i, matchScore(highlights, p1s[i].size(), p2.size()), std::move(highlights)});
             }
+        });
+        for (auto &heap : heaps) {
+            std::move(heap.begin(), heap.end(), std::back_inserter(matches));
+        }
+        if (stats) {
+            for (auto n : numPruned) {
+                stats->numPruned += n;
+            }
+        }
+        std::sort(matches.begin(), matches.end(), betterMatch);
+        if (matches.size() > numResults) {
+            matches.resize(numResults);
         }
         return matches;
     }
 
-    std::vector<std::size_t> simpleMatchPinyin(PinyinDB &db,
+    std::vector<std::size_t> simpleMatchPinyin(PinyinDB const &db,
         std::vector<std::string> const &candidates, std::string const &query,
         std::size_t numResults = (std::size_t)-1) {
         auto qPids = db.pinyinSplit(utfCto32(query), true);
@@ -137,8 +221,7 @@ struct PinyinMatch {
         for (auto &c : candidates) {
             cPidSets.emplace_back(db.stringToPinyin(utfCto32(c), true));
         }
-        auto matches = batchedMatchPinyin(cPidSets, qPids);
-        sortTopN(matches, numResults, &MatchResult::score);
+        auto matches = batchedMatchPinyin(cPidSets, qPids, numResults);
         std::vector<std::size_t> indices;
         indices.reserve(std::min(numResults, matches.size()));
         for (auto const &m: matches) {
@@ -149,7 +232,7 @@ struct PinyinMatch {
     }
 
     template <class Id>
-    std::vector<Id> simpleAliasedMatchPinyin(PinyinDB &db,
+    std::vector<Id> simpleAliasedMatchPinyin(PinyinDB const &db,
         std::vector<std::pair<Id, std::vector<std::string>>> const &candidates, std::string const &query,
         std::size_t numResults = (std::size_t)-1) {
         auto qPids = db.pinyinSplit(utfCto32(query), true);
@@ -195,7 +278,34 @@ struct PinyinMatch {
         std::string text;
     };
 
-    std::vector<HighlightMatchResult> simpleHighlightMatchPinyin(PinyinDB &db,
+    static std::string highlightText(std::u32string_view source, std::vector<std::size_t> const &highlights,
+        std::string const &hlBegin = "<em>", std::string const &hlEnd = "</em>") {
+        std::string text;
+        std::vector<bool> activated(source.size());
+        for (std::size_t highlight : highlights) {
+            activated[highlight] = true;
+        }
+        bool active = false;
+        for (std::size_t i = 0; i < source.size(); ++i) {
+            if (activated[i]) {
+                if (!active) {
+                    text.append(hlBegin);
+                }
+            } else {
+                if (active) {
+                    text.append(hlEnd);
+                }
+            }
+            active = activated[i];
+            utf32toC(source[i], text);
+        }
+        if (active) {
+            text.append(hlEnd);
+        }
+        return text;
+    }
+
+    std::vector<HighlightMatchResult> simpleHighlightMatchPinyin(PinyinDB const &db,
         std::vector<std::string> const &candidates, std::string const &query, std::size_t numResults = (std::size_t)-1,
         std::string const &hlBegin = "<em>", std::string const &hlEnd = "</em>") {
         auto qPids = db.pinyinSplit(utfCto32(query), true);
@@ -208,34 +318,11 @@ struct PinyinMatch {
         for (auto &c : candidatesUtf32) {
             results.emplace_back(db.stringToPinyin(c, true));
         }
-        auto matches = batchedMatchPinyin(results, qPids);
-        sortTopN(matches, numResults, &MatchResult::score);
+        auto matches = batchedMatchPinyin(results, qPids, numResults);
         std::vector<HighlightMatchResult> result;
         result.reserve(std::min(numResults, matches.size()));
         for (auto const &m: matches) {
-            std::string text;
-            std::u32string source = candidatesUtf32[m.index];
-            std::vector<bool> activated(source.size());
-            for (std::size_t highlight : m.highlights) {
-                activated[highlight] = true;
-            }
-            bool active = false;
-            for (std::size_t i = 0; i < source.size(); ++i) {
-                if (activated[i]) {
-                    if (!active) {
-                        text.append(hlBegin);
-                    }
-                } else {
-                    if (active) {
-                        text.append(hlEnd);
-                    }
-                }
-                active = activated[i];
-                text.append(utf32toC(source[i]));
-            }
-            if (active) {
-                text.append(hlEnd);
-            }
+            auto text = highlightText(candidatesUtf32[m.index], m.highlights, hlBegin, hlEnd);
             result.push_back({m.index, m.score, text});
             if (result.size() >= numResults) break;
         }
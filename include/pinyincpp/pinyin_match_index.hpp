@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <pinyincpp/utf8.hpp>
+#include <pinyincpp/pinyin_chars.hpp>
+#include <pinyincpp/pinyin_match.hpp>
+#include <pinyincpp/bit_lcs.hpp>
+#include <pinyincpp/pid_signature.hpp>
+
+namespace pinyincpp {
+
+// candidate strings converted to pinyin once, stored as CSR arrays: entry -> chars -> pids,
+// an id may own several entries (aliases), removed entries are tombstoned until compaction
+template <class Id = std::size_t>
+struct PinyinMatchIndex {
+    struct MatchResult {
+        Id id;
+        std::size_t alias;
+        double score;
+        std::vector<std::size_t> highlights;
+    };
+
+private:
+    std::vector<Id> entryIds;
+    std::vector<std::uint32_t> entryAliases;
+    std::vector<bool> entryAlive;
+    std::vector<PidSignature> entrySignatures;
+    std::vector<std::uint32_t> entryChars{0}; // numEntries + 1 offsets into charPids and text
+    std::vector<std::uint32_t> charPids{0}; // numChars + 1 offsets into pids
+    std::vector<Pid> pids;
+    std::u32string text;
+    std::unordered_map<Id, std::vector<std::uint32_t>> idEntries;
+    std::size_t numDead = 0;
+
+    // text of one entry as seen by BitLcs: a sequence of pid sets
+    struct EntryPinyin {
+        PinyinMatchIndex const *index;
+        std::uint32_t firstChar;
+        std::uint32_t numChars;
+
+        std::size_t size() const noexcept {
+            return numChars;
+        }
+
+        std::span<Pid const> operator[](std::size_t i) const noexcept {
+            auto const &offsets = index->charPids;
+            auto c = firstChar + i;
+            return {index->pids.data() + offsets[c], offsets[c + 1] - offsets[c]};
+        }
+    };
+
+    EntryPinyin entryPinyin(std::uint32_t e) const noexcept {
+        return {this, entryChars[e], entryChars[e + 1] - entryChars[e]};
+    }
+
+    void compact() {
+        PinyinMatchIndex live;
+        for (std::uint32_t e = 0; e < entryIds.size(); ++e) {
+            if (!entryAlive[e]) {
+                continue;
+            }
+            auto entry = entryPinyin(e);
+            live.appendEntry(entryIds[e], entryAliases[e], std::u32string_view(text).substr(entry.firstChar, entry.numChars), [&] (std::size_t i) {
+                return entry[i];
+            });
+        }
+        *this = std::move(live);
+    }
+
+    template <class CharPids>
+    void appendEntry(Id const &id, std::uint32_t alias, std::u32string_view str, CharPids &&charPidsAt) {
+        auto &entries = idEntries[id];
+        entries.push_back(entryIds.size());
+        entryIds.push_back(id);
+        entryAliases.push_back(alias);
+        entryAlive.push_back(true);
+        auto &signature = entrySignatures.emplace_back();
+        for (std::size_t i = 0; i < str.size(); ++i) {
+            auto const &set = charPidsAt(i);
+            for (Pid pid : set) {
+                signature.add(pid);
+            }
+            pids.insert(pids.end(), set.begin(), set.end());
+            charPids.push_back(pids.size());
+        }
+        text.append(str);
+        entryChars.push_back(text.size());
+    }
+
+public:
+    // number of ids
+    std::size_t size() const noexcept {
+        return idEntries.size();
+    }
+
+    bool contains(Id const &id) const {
+        return idEntries.find(id) != idEntries.end();
+    }
+
+    void clear() {
+        *this = PinyinMatchIndex();
+    }
+
+    // add a candidate string to id, each call adds one more alias
+    void add(PinyinDB const &db, Id const &id, std::string const &candidate) {
+        auto str = utfCto32(candidate);
+        auto sets = db.stringToPinyin(str, true);
+        auto it = idEntries.find(id);
+        std::uint32_t alias = it == idEntries.end() ? 0 : it->second.size();
+        appendEntry(id, alias, str, [&] (std::size_t i) -> PidSet const & {
+            return sets[i];
+        });
+    }
+
+    void add(PinyinDB const &db, Id const &id, std::vector<std::string> const &aliases) {
+        for (auto const &candidate : aliases) {
+            add(db, id, candidate);
+        }
+    }
+
+    // remove id with all its aliases, returns false if not found
+    bool remove(Id const &id) {
+        auto it = idEntries.find(id);
+        if (it == idEntries.end()) {
+            return false;
+        }
+        for (auto e : it->second) {
+            entryAlive[e] = false;
+        }
+        numDead += it->second.size();
+        idEntries.erase(it);
+        if (numDead > entryIds.size() / 2) {
+            compact();
+        }
+        return true;
+    }
+
+    std::u32string_view candidate(Id const &id, std::size_t alias = 0) const {
+        auto e = idEntries.at(id).at(alias);
+        return std::u32string_view(text).substr(entryChars[e], entryChars[e + 1] - entryChars[e]);
+    }
+
+    // best alias of the best numResults ids ordered by score, ties in order of insertion,
+    // aliases whose pid signature has fewer than minMatches of the query pids are pruned before the lcs
+    std::vector<MatchResult> matchPinyin(std::vector<Pid> const &query, std::size_t numResults = (std::size_t)-1,
+        std::size_t minMatches = 1, PinyinMatch::MatchStats *stats = nullptr) const {
+        std::vector<MatchResult> results;
+        if (stats) {
+            *stats = {entryIds.size() - numDead, 0};
+        }
+        if (!numResults || query.empty()) [[unlikely]] {
+            return results;
+        }
+        BitLcs<Pid> lcs(query);
+        // score bound of an id is the max over its aliases
+        std::unordered_map<std::uint32_t, double> firstEntryBounds;
+        for (std::uint32_t e = 0; e < entryIds.size(); ++e) {
+            if (!entryAlive[e]) {
+                continue;
+            }
+            if (entrySignatures[e].possibleMatches(query) < minMatches) {
+                if (stats) {
+                    ++stats->numPruned;
+                }
+                continue;
+            }
+            auto entry = entryPinyin(e);
+            if (auto len = lcs.run(entry)) {
+                auto first = idEntries.find(entryIds[e])->second.front();
+                auto bound = PinyinMatch::matchScoreBound(len, entry.size(), query.size());
+                auto [it, success] = firstEntryBounds.try_emplace(first, bound);
+                if (!success) {
+                    it->second = std::max(it->second, bound);
+                }
+            }
+        }
+        std::vector<std::pair<double, std::uint32_t>> bounds;
+        bounds.reserve(firstEntryBounds.size());
+        for (auto const &[first, bound] : firstEntryBounds) {
+            bounds.emplace_back(bound, first);
+        }
+        std::sort(bounds.begin(), bounds.end(), [] (auto const &a, auto const &b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+        std::vector<std::pair<std::uint32_t, MatchResult>> kept;
+        auto better = [] (auto const &a, auto const &b) {
+            return a.second.score != b.second.score ? a.second.score > b.second.score : a.first < b.first;
+        };
+        // heap with the worst kept id on top
+        for (auto const &[bound, first] : bounds) {
+            if (kept.size() >= numResults && bound < kept.front().second.score) {
+                break;
+            }
+            std::pair<std::uint32_t, MatchResult> best{first, {entryIds[first], 0, 0, {}}};
+            for (auto e : idEntries.find(entryIds[first])->second) {
+                auto entry = entryPinyin(e);
+                if (entrySignatures[e].possibleMatches(query) < minMatches || !lcs.run(entry)) {
+                    continue;
+                }
+                auto highlights = lcs.traceback();
+                double score = PinyinMatch::matchScore(highlights, entry.size(), query.size());
+                if (score > best.second.score) {
+                    best.second = {entryIds[e], entryAliases[e], score, std::move(highlights)};
+                }
+            }
+            if (kept.size() < numResults) {
+                kept.push_back(std::move(best));
+                std::push_heap(kept.begin(), kept.end(), better);
+            } else if (better(best, kept.front())) {
+                std::pop_heap(kept.begin(), kept.end(), better);
+                kept.back() = std::move(best);
+                std::push_heap(kept.begin(), kept.end(), better);
+            }
+        }
+        std::sort_heap(kept.begin(), kept.end(), better);
+        results.reserve(kept.size());
+        for (auto &[first, m] : kept) {
+            results.push_back(std::move(m));
+        }
+        return results;
+    }
+
+    std::vector<MatchResult> match(PinyinDB const &db, std::string const &query, std::size_t numResults = (std::size_t)-1,
+        std::size_t minMatches = 1, PinyinMatch::MatchStats *stats = nullptr) const {
+        return matchPinyin(db.pinyinSplit(utfCto32(query), true), numResults, minMatches, stats);
+    }
+
+    std::vector<Id> matchIds(PinyinDB const &db, std::string const &query, std::size_t numResults = (std::size_t)-1) const {
+        std::vector<Id> ids;
+        for (auto const &m : match(db, query, numResults)) {
+            ids.push_back(m.id);
+        }
+        return ids;
+    }
+
+    std::string highlight(MatchResult const &result, std::string const &hlBegin = "<em>", std::string const &hlEnd = "</em>") const {
+        return PinyinMatch::highlightText(candidate(result.id, result.alias), result.highlights, hlBegin, hlEnd);
+    }
+};
+
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <pinyincpp/utf8.hpp>
+#include <pinyincpp/pinyin_chars.hpp>
+#include <pinyincpp/pinyin_words.hpp>
+#include <pinyincpp/pinyin_lattice.hpp>
+
+namespace pinyincpp {
+
+// one reading per char of a hanzi text chosen from its context: the text is segmented by a viterbi over
+// dictionary words and single chars, a word fixes the toned readings of its chars, a char left alone takes
+// the reading it has most often across the dictionary words, or else its first reading; these preferred
+// readings are counted at construction, so it should be built again after words are added to the PinyinWordsDB
+struct PinyinPolyphone {
+    static constexpr double kEdgePenalty = 8.0; // per segment, so a text is split into as few words as it can
+    static constexpr double kOtherReadingPenalty = 4.0; // per char read other than its preferred reading
+    static constexpr std::size_t kMaxWordChars = 8;
+
+    struct Reading {
+        std::vector<Pid> pids; // one per char, the special pid for chars without a reading
+        std::vector<std::uint8_t> tones;
+        std::vector<std::size_t> boundaries; // char position where each word or char ends
+        double score;
+    };
+
+private:
+    struct Edge {
+        std::uint32_t begin;
+        std::uint32_t end;
+        std::uint32_t wordIndex; // -1 for a single char read as pid and tone
+        Pid pid;
+        std::uint8_t tone;
+        double score;
+    };
+
+    PinyinDB const *db;
+    PinyinWordsDB const *wd;
+    std::unordered_map<char32_t, std::uint16_t> charReadings; // packed pid << 3 | tone, polyphones only
+
+    bool validWord(std::size_t wordIndex, std::size_t numChars) const {
+        auto pinyin = wd->wordData.pinyin(wordIndex);
+        return pinyin.size() == numChars && std::none_of(pinyin.begin(), pinyin.end(), [&] (PidTone p) {
+            return p.pid < 0 || p.pid >= db->pinyinPidLimit();
+        });
+    }
+
+    std::pair<Pid, std::uint8_t> charReading(char32_t c) const {
+        if (auto it = charReadings.find(c); it != charReadings.end()) {
+            return {static_cast<Pid>(it->second >> 3), static_cast<std::uint8_t>(it->second & 7)};
+        }
+        auto readings = db->charToPinyinToned(c);
+        if (!readings || readings->empty()) {
+            return {makeSpecialPid(c), 0};
+        }
+        return {(*readings)[0].pid, (*readings)[0].tone};
+    }
+
+public:
+    PinyinPolyphone(PinyinDB const &db, PinyinWordsDB const &wd) : db(&db), wd(&wd) {
+        // probability mass of each reading of each polyphone over the words having it
+        std::unordered_map<std::uint64_t, double> weights;
+        for (std::size_t i = 0; i < wd.wordData.size(); ++i) {
+            auto w = wd.wordData[i];
+            auto chars = utf16to32(w.word);
+            if (chars.size() < 2 || !validWord(i, chars.size())) {
+                continue;
+            }
+            for (std::size_t j = 0; j < chars.size(); ++j) {
+                auto readings = db.charToPinyinToned(chars[j]);
+                if (readings && readings->size() > 1) {
+                    std::uint64_t packed = static_cast<std::uint16_t>(w.pinyin[j].pid << 3 | w.pinyin[j].tone);
+                    weights[std::uint64_t(chars[j]) << 16 | packed] += std::exp(static_cast<double>(w.score));
+                }
+            }
+        }
+        std::unordered_map<char32_t, double> best;
+        for (auto const &[key, weight] : weights) {
+            char32_t c = key >> 16;
+            auto [it, success] = best.try_emplace(c, weight);
+            // ties broken by the smaller packed reading, so the choice does not depend on hash order
+            if (success || weight > it->second || (weight == it->second && (key & 0xFFFF) < charReadings[c])) {
+                it->second = weight;
+                charReadings[c] = key & 0xFFFF;
+            }
+        }
+    }
+
+    // the k best distinct readings of text, k-best viterbi over char positions
+    std::vector<Reading> kBest(std::u32string_view text, std::size_t k) const {
+        std::vector<Reading> results;
+        std::size_t n = text.size();
+        if (!k || !n) [[unlikely]] {
+            return results;
+        }
+        std::u16string text16;
+        std::vector<std::uint32_t> offsets; // of each char in text16
+        offsets.reserve(n + 1);
+        for (char32_t c : text) {
+            offsets.push_back(text16.size());
+            if (c < 0x10000) [[likely]] {
+                text16.push_back(static_cast<char16_t>(c));
+            } else {
+                text16.push_back(static_cast<char16_t>(0xD800 + ((c - 0x10000) >> 10)));
+                text16.push_back(static_cast<char16_t>(0xDC00 + ((c - 0x10000) & 0x3FF)));
+            }
+        }
+        offsets.push_back(text16.size());
+        std::vector<Edge> edges;
+        for (std::size_t i = 0; i < n; ++i) {
+            auto [pid, tone] = charReading(text[i]);
+            double score = db->charLogFrequency(text[i]) - kEdgePenalty;
+            edges.push_back({static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(i + 1), (std::uint32_t)-1, pid, tone, score});
+            // other readings only matter to the k best
+            if (k > 1 && !isSpecialPid(pid)) {
+                auto readings = db->charToPinyinToned(text[i]);
+                for (auto p : *readings) {
+                    if (p.pid != pid || p.tone != tone) {
+                        edges.push_back({static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(i + 1), (std::uint32_t)-1,
+                                         static_cast<Pid>(p.pid), static_cast<std::uint8_t>(p.tone), score - kOtherReadingPenalty});
+                    }
+                }
+            }
+            for (std::size_t j = i + 2; j <= n && j - i <= kMaxWordChars; ++j) {
+                wd->visitWord(std::u16string_view(text16).substr(offsets[i], offsets[j] - offsets[i]), [&] (std::size_t wordIndex) {
+                    if (validWord(wordIndex, j - i)) {
+                        edges.push_back({static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(j), static_cast<std::uint32_t>(wordIndex), 0, 0,
+                                         wd->wordData.score(wordIndex) * (j - i) - kEdgePenalty});
+                    }
+                    return false;
+                });
+            }
+        }
+        std::stable_sort(edges.begin(), edges.end(), [] (Edge const &a, Edge const &b) {
+            return a.end < b.end;
+        });
+        auto appendReading = [&] (Edge const &edge, auto &&visit) {
+            if (edge.wordIndex == (std::uint32_t)-1) {
+                visit(edge.pid, edge.tone);
+            } else {
+                for (auto p : wd->wordData.pinyin(edge.wordIndex)) {
+                    visit(static_cast<Pid>(p.pid), static_cast<std::uint8_t>(p.tone));
+                }
+            }
+        };
+        // a reading is compared as its packed pid and tone per char, whatever words it came from
+        auto found = kBestPaths<std::uint32_t>(std::span<Edge const>(edges), n, k, k, [&] (Edge const &edge, auto &&visit) {
+            appendReading(edge, [&] (Pid pid, std::uint8_t tone) {
+                visit(static_cast<std::uint32_t>(pid) << 3 | tone);
+            });
+        });
+        for (auto const &f : found) {
+            auto &reading = results.emplace_back();
+            reading.score = f.score;
+            for (auto e : f.edges) {
+                appendReading(edges[e], [&] (Pid pid, std::uint8_t tone) {
+                    reading.pids.push_back(pid);
+                    reading.tones.push_back(tone);
+                });
+                reading.boundaries.push_back(edges[e].end);
+            }
+        }
+        return results;
+    }
+
+    Reading bestReading(std::u32string_view text) const {
+        auto readings = kBest(text, 1);
+        return readings.empty() ? Reading{{}, {}, {}, 0.0} : std::move(readings.front());
+    }
+
+    // one pid per char, the same shape as PinyinDB::stringToPinyin with each set narrowed to its best pid
+    std::vector<PidSet> stringToPinyin(std::u32string_view text) const {
+        std::vector<PidSet> result;
+        result.reserve(text.size());
+        auto reading = bestReading(text);
+        for (std::size_t i = 0; i < reading.pids.size(); ++i) {
+            auto &set = result.emplace_back();
+            set.push_back(reading.pids[i]);
+            if (!isSpecialPid(reading.pids[i])) {
+                set.push_back(makeSpecialPid(text[i]));
+            }
+        }
+        return result;
+    }
+};
+
+}
@@ -3,31 +3,215 @@
 #include <pinyincpp/pinyin_chars.hpp>
 #include <pinyincpp/pinyin_words.hpp>
 #include <pinyincpp/pinyin_input.hpp>
+#include <pinyincpp/pinyin_lattice.hpp>
 #include <pinyincpp/pinyin_englify.hpp>
 #include <pinyincpp/ctype.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace pinyincpp {
 
-struct PinyinServer {
+// the dictionaries read by PinyinServer::onInput, never changed once published and replaced as a whole
+// when an update is loaded, so any number of threads may read one at once
+struct PinyinDictionary {
     PinyinDB db;
     PinyinWordsDB wd;
     PinyinEnglifyDB ed{db};
-    PinyinInput im;
+
+    PinyinDictionary() = default;
+
+    PinyinDictionary(PinyinDB db, PinyinWordsDB wd) : db(std::move(db)), wd(std::move(wd)) {}
+
+    // a snapshot written by PinyinDB::saveSnapshot and a data/pinyin-words.bin, both checksummed
+    static std::shared_ptr<PinyinDictionary const> open(std::string const &snapshotPath, std::string const &wordsPath) {
+        return std::make_shared<PinyinDictionary const>(PinyinDB::openSnapshot(snapshotPath), PinyinWordsDB::openWords(wordsPath));
+    }
+};
+
+// the mutable state of a user over the shared dictionaries: sample strings and custom words; a change edits
+// a copy of the current Layer and publishes it, so a layer is never changed once readers can see it; the
+// samples, the definitions and the custom words are separate immutable parts shared by copies, a change only
+// copies the part it edits: a sample copies the sample pointers and the per char sums, O(samples + distinct
+// chars), a definition copies the definitions and spells the custom words again; the custom words are built
+// by the writer, for the dictionary the layer is attached to, so readers never build them
+struct PinyinOverlay {
+    using WordDefinitions = std::vector<std::pair<std::string, std::string>>; // pinyin and words, e.g. ni hao=你好
+    using DefinitionList = std::vector<std::pair<WordDefinitions, double>>; // with the factor of each call
+
+    struct Layer {
+        std::shared_ptr<PinyinInput const> im = std::make_shared<PinyinInput const>();
+        std::shared_ptr<DefinitionList const> definitions = std::make_shared<DefinitionList const>();
+        std::shared_ptr<PinyinDictionary const> dict;        // null until attached to a server
+        std::shared_ptr<PinyinWordsDB const> customWords;    // definitions spelled with the pids of dict, null if none
+    };
+
+private:
+    std::atomic<std::shared_ptr<Layer const>> current;
+    std::atomic<std::uint64_t> published{0}; // bumped after each layer is published
+    std::mutex updateMutex;
+
+    static std::shared_ptr<PinyinWordsDB const> buildCustomWords(PinyinDictionary const *dict, DefinitionList const &definitions) {
+        if (!dict || definitions.empty()) {
+            return nullptr;
+        }
+        auto wd = std::make_shared<PinyinWordsDB>(PinyinWordsDB::emptyWords());
+        for (auto const &[pinyinAndWords, factor] : definitions) {
+            wd->addCustomWords(dict->db, pinyinAndWords, factor);
+        }
+        wd->freeze();
+        return wd;
+    }
+
+public:
+    PinyinOverlay() : current(std::make_shared<Layer const>()) {}
+
+    explicit PinyinOverlay(std::shared_ptr<Layer const> layer) : current(std::move(layer)) {}
+
+    // std::atomic<std::shared_ptr> takes a lock in libstdc++, readers keep the layer they loaded
+    // and load it again only when version() moved on
+    std::shared_ptr<Layer const> layer() const noexcept {
+        return current.load(std::memory_order_acquire);
+    }
+
+    // lock-free, changes after each publish; a layer loaded after reading a version is at least that new
+    std::uint64_t version() const noexcept {
+        return published.load(std::memory_order_acquire);
+    }
+
+    // a new overlay starting from the current layer of this one, later changes to either are not shared
+    std::shared_ptr<PinyinOverlay> fork() const {
+        return std::make_shared<PinyinOverlay>(layer());
+    }
+
+    // edit(Layer &) is applied to a copy of the current layer, which is then published, writers take turns;
+    // the copy shares the parts of the current layer, edit replaces the ones it changes
+    template <class Edit>
+    void update(Edit &&edit) {
+        std::lock_guard lock(updateMutex);
+        auto next = std::make_shared<Layer>(*layer());
+        edit(*next);
+        current.store(std::move(next), std::memory_order_release);
+        published.fetch_add(1, std::memory_order_release);
+    }
+
+    void addSampleString(std::string const &sample, double factor = 1.0) {
+        auto sampleUtf32 = utfCto32(sample);
+        update([&] (Layer &next) {
+            auto im = std::make_shared<PinyinInput>(*next.im);
+            im->addSampleString(sampleUtf32, factor);
+            next.im = std::move(im);
+        });
+    }
+
+    void defineWords(WordDefinitions pinyinAndWords, double factor = 1.0) {
+        update([&] (Layer &next) {
+            auto definitions = std::make_shared<DefinitionList>(*next.definitions);
+            definitions->emplace_back(std::move(pinyinAndWords), factor);
+            next.definitions = std::move(definitions);
+            next.customWords = buildCustomWords(next.dict.get(), *next.definitions);
+        });
+    }
+
+    // publish a layer over dict, with the custom words spelled again for it unless it is already the one
+    void attach(std::shared_ptr<PinyinDictionary const> const &dict) {
+        if (layer()->dict == dict) {
+            return;
+        }
+        update([&] (Layer &next) {
+            next.dict = dict;
+            next.customWords = buildCustomWords(dict.get(), *next.definitions);
+        });
+    }
+};
+
+// read-mostly input method server: the dictionaries and the overlays are published as immutable snapshots,
+// each layer of an overlay holding the dictionary it was attached to, so a session pins everything it reads
+// with the one layer; a session reads the lock-free version of its overlay on each call and loads the layer,
+// which locks inside std::atomic<std::shared_ptr> and touches shared reference counts, only when the version
+// changed; any number of sessions may run at once while updates publish new snapshots, and an old snapshot
+// is freed when the last session holding it moves on, so publishing never waits for readers
+struct PinyinServer {
+private:
+    std::atomic<std::shared_ptr<PinyinDictionary const>> current{std::make_shared<PinyinDictionary const>()};
+    std::shared_ptr<PinyinOverlay> sharedOverlay = std::make_shared<PinyinOverlay>();
+    std::mutex overlaysMutex;
+    // the registered overlays, attached again by swapDictionary
+    std::unordered_map<PinyinOverlay const *, std::weak_ptr<PinyinOverlay>> overlays;
+
+    void pruneOverlays() {
+        std::erase_if(overlays, [] (auto const &entry) { return entry.second.expired(); });
+    }
+
+public:
+    PinyinServer() {
+        registerOverlay(sharedOverlay);
+    }
+
+    // attach overlay to the current dictionary and keep it attached through later swaps, once per overlay
+    // before sessions use it; newOverlay does this itself, sessions only read the overlay
+    void registerOverlay(std::shared_ptr<PinyinOverlay> const &overlay) {
+        std::lock_guard lock(overlaysMutex);
+        pruneOverlays();
+        overlays[overlay.get()] = overlay;
+        overlay->attach(dictionary());
+    }
+
+    std::shared_ptr<PinyinDictionary const> dictionary() const noexcept {
+        return current.load(std::memory_order_acquire);
+    }
+
+    // calls already running finish on the old dictionary; the custom words of every overlay in use are
+    // spelled again for the new one before this returns, so readers never build them
+    void swapDictionary(std::shared_ptr<PinyinDictionary const> next) {
+        std::lock_guard lock(overlaysMutex);
+        current.store(next, std::memory_order_release);
+        pruneOverlays();
+        for (auto const &entry : overlays) {
+            if (auto overlay = entry.second.lock()) {
+                overlay->attach(next);
+            }
+        }
+    }
+
+    // throws and keeps the current dictionary if either file is missing, truncated or corrupt
+    void loadDictionary(std::string const &snapshotPath, std::string const &wordsPath) {
+        swapDictionary(PinyinDictionary::open(snapshotPath, wordsPath));
+    }
+
+    // the overlay changed by onLoadSample and onDefineWords, used by sessions not given their own
+    std::shared_ptr<PinyinOverlay> const &overlay() const noexcept {
+        return sharedOverlay;
+    }
+
+    // an overlay for one user, starting from the samples and words of the shared one, already registered
+    std::shared_ptr<PinyinOverlay> newOverlay() {
+        auto overlay = sharedOverlay->fork();
+        registerOverlay(overlay);
+        return overlay;
+    }
 
     void onLoadSample(std::string const &in, double factor = 1.0) {
         // todo: remove english chunks in it...
-        im.addSampleString(in, factor);
+        sharedOverlay->addSampleString(in, factor);
         // todo: find small chunks to add as word...
     }
 
-    void onDefineWords(std::string const &in, double factor = 1.0) {
+    static PinyinOverlay::WordDefinitions parseWordDefinitions(std::string const &in) {
         // format e.g:
         // ni hao=你好
         std::istringstream iss(in);
         std::string line;
-        std::vector<std::pair<std::string, std::string>> pinyinAndWords;
+        PinyinOverlay::WordDefinitions pinyinAndWords;
         while (std::getline(iss, line)) {
             std::istringstream ss(line);
             std::string pinyin;
@@ -36,7 +220,11 @@ struct PinyinServer {
                 pinyinAndWords.push_back({pinyin, words});
             }
         }
-        wd.addCustomWords(db, pinyinAndWords, factor);
+        return pinyinAndWords;
+    }
+
+    void onDefineWords(std::string const &in, double factor = 1.0) {
+        sharedOverlay->defineWords(parseWordDefinitions(in), factor);
     }
 
     struct Candidate {
@@ -56,9 +244,14 @@ struct PinyinServer {
         static constexpr const char *tupnames[] = {"candidates", "fixedPrefix", "fixedEatBytes"};
     };
 
-    static bool isSeemsPinyin(PinyinDB &db, std::u32string const &prefixUtf32, std::vector<Pid> const &pids) {
+    static bool isSeemsPinyin(PinyinDB const &db, std::u32string const &prefixUtf32, std::vector<Pid> const &pids) {
+        return isSeemsPinyin(db, chineseEnglishFraction(prefixUtf32), pids);
+    }
+
+    // same as above with chineseEnglishFraction of the prefix already computed
+    static bool isSeemsPinyin(PinyinDB const &db, std::pair<int, int> prefixFraction, std::vector<Pid> const &pids) {
         int englishTendency = 0;
-        auto [numCnPrefix, numEnPrefix] = chineseEnglishFraction(prefixUtf32);
+        auto [numCnPrefix, numEnPrefix] = prefixFraction;
         if (numCnPrefix * 2 > numEnPrefix * 3) {
             englishTendency -= 1;
         } else if (numEnPrefix * 2 > numCnPrefix * 3) {
@@ -121,72 +314,296 @@ struct PinyinServer {
         return pinyinCount != 0 && specialCount * (5 + englishTendency) < pinyinCount + 13;
     }
 
-    InputResult onInput(std::string const &prefix, std::string const &in, std::size_t num = 100) {
-        InputResult result{};
-        std::size_t inpos, pos;
-        auto s = ed.enggyToString(in, &inpos, &pos);
-        if (inpos == std::string::npos) {
-            inpos = in.size();
-        }
-        std::string past = s.substr(0, pos);
-        std::string rest = s.substr(pos);
-        auto prefixUtf32 = utfCto32(prefix + past);
-        if (rest.empty()) {
-            if (!prefixUtf32.empty() && isChineseCharacter(prefixUtf32.back())) {
-                result.fixedPrefix = past;
-                result.fixedEatBytes = inpos;
-                for (auto c: im.suggestCharCandidates(prefixUtf32, num)) {
-                    auto enggy = ed.charToEnggy(c.character);
-                    result.candidates.push_back({utf32toC(c.character), enggy, c.score});
+    // per user state of onInput, for each keystroke the input usually only grows or changes near its end:
+    // the pinyin split resumes from the last checkpoint before the first changed char, the word trie walks
+    // only descend from the first changed pid, and the prefix dependent char scores are kept while the
+    // prefix and the samples stay the same; words are looked up for the split of pinyinSplit and the other
+    // best segmentations of a PinyinLattice over the input at once, the lattice is kept and only rebuilt
+    // from the first changed char; all of it is dropped when the server swaps its dictionary; the session keeps the layer it last read until the overlay publishes another
+    // or reset() is called, results are the same as onInput of the server; a session is used by one thread
+    // at a time, each thread or user has its own
+    struct Session {
+        explicit Session(PinyinServer &server) : overlay(server.overlay()) {}
+
+        // overlay must come from newOverlay or be passed to registerOverlay first, no lock is taken here
+        Session(PinyinServer &, std::shared_ptr<PinyinOverlay> overlay) : overlay(std::move(overlay)) {}
+
+        InputResult onInput(std::string const &prefix, std::string const &in, std::size_t num = 100) {
+            auto version = overlay->version();
+            if (!layer || version != layerVersion) [[unlikely]] {
+                pin(version);
+            }
+            auto const &pinned = layer->dict;
+            auto const *custom = layer->customWords.get();
+            auto const &db = pinned->db;
+            auto const &wd = pinned->wd;
+            auto const &ed = pinned->ed;
+            auto const &im = *layer->im;
+            // words of a trie for the longest prefix of the pids of split that is still in it, so a trailing
+            // partial syllable does not hide the words before it, each eating the input of that prefix
+            auto addWords = [&] (PinyinWordsDB const &trie, TrieWalk<PinyinWordsDB, Pid> &walk, Split const &split,
+                                 std::size_t numResults, std::vector<Candidate> &out) {
+                walk.walk(split.pids);
+                while (walk.depth() > 2 && !walk) {
+                    walk.pop();
+                }
+                if (walk.depth() < 2 || !walk) {
+                    return;
                 }
+                for (auto c: im.pinyinWordCandidates(db, trie, prefixUtf32, walk, numResults)) {
+                    std::string enggy;
+                    for (std::size_t i = 0; i < c.word.size(); i++) {
+                        enggy += ed.charToEnggy(c.word[i], i < c.pinyin.size() ? c.pinyin[i] : makeSpecialPid(c.word[i]));
+                    }
+                    out.push_back({utf32toC(c.word), enggy, c.score - split.penalty, split.byteIndices[walk.depth() - 1]});
+                }
+            };
+            InputResult result{};
+            std::size_t inpos, pos;
+            auto s = ed.enggyToString(in, &inpos, &pos);
+            if (inpos == std::string::npos) {
+                inpos = in.size();
             }
-        } else {
-            std::vector<std::size_t> indices;
-            auto restUtf32 = utfCto32(rest);
-            auto pids = db.pinyinSplit(restUtf32, false, U'0', &indices);
-            if (!pids.empty()) {
-                if (isSeemsPinyin(db, prefixUtf32, pids)) {
+            std::string past = s.substr(0, pos);
+            std::string rest = s.substr(pos);
+            updatePrefix(prefix + past);
+            if (rest.empty()) {
+                if (!prefixUtf32.empty() && isChineseCharacter(prefixUtf32.back())) {
                     result.fixedPrefix = past;
                     result.fixedEatBytes = inpos;
-                    std::vector<std::size_t> byteIndices;
-                    byteIndices.reserve(indices.size());
-                    for (std::size_t i: indices) {
-                        byteIndices.push_back(utf32toC(restUtf32.substr(0, i)).size());
-                    }
-                    if (pids.size() == 1 && num > result.candidates.size()) {
-                        for (auto c: im.pinyinCharCandidates(db, prefixUtf32, pids.front(), num - result.candidates.size())) {
-                            auto enggy = ed.charToEnggy(c.character, pids.front());
-                            result.candidates.push_back({utf32toC(c.character), enggy, c.score, byteIndices[0]});
-                        }
+                    for (auto c: im.suggestCharCandidates(prefixUtf32, num)) {
+                        auto enggy = ed.charToEnggy(c.character);
+                        result.candidates.push_back({utf32toC(c.character), enggy, c.score});
                     }
-                    if (pids.size() > 1 && num > result.candidates.size()) {
-                        for (auto c: im.pinyinWordCandidates(db, wd, prefixUtf32, pids, num - result.candidates.size())) {
-                            std::string enggy;
-                            for (std::size_t i = 0; i < c.word.size(); i++) {
-                                enggy += ed.charToEnggy(c.word[i], i < c.pinyin.size() ? c.pinyin[i] : makeSpecialPid(c.word[i]));
+                }
+            } else {
+                updateRest(db, utfCto32(rest));
+                auto const &pids = restPids;
+                if (!pids.empty()) {
+                    if (isSeemsPinyin(db, prefixFraction, pids)) {
+                        result.fixedPrefix = past;
+                        result.fixedEatBytes = inpos;
+                        auto const &byteIndices = restByteIndices;
+                        if (pids.size() == 1 && num > result.candidates.size()) {
+                            for (auto c: im.pinyinCharCandidates(db, prefixOccurance(im), pids.front(), num - result.candidates.size())) {
+                                auto enggy = ed.charToEnggy(c.character, pids.front());
+                                result.candidates.push_back({utf32toC(c.character), enggy, c.score, byteIndices[0]});
                             }
-                            result.candidates.push_back({utf32toC(c.word), enggy, c.score, byteIndices[std::min(pids.size() - 1, byteIndices.size() - 1)]});
                         }
-                        if (result.candidates.size() == 0 && num != 0 && pids.size() > 2) {
-                            pids.pop_back();
-                            for (auto c: im.pinyinWordCandidates(db, wd, prefixUtf32, pids, num - result.candidates.size())) {
-                                std::string enggy;
-                                for (std::size_t i = 0; i < c.word.size(); i++) {
-                                    enggy += ed.charToEnggy(c.word[i], i < c.pinyin.size() ? c.pinyin[i] : makeSpecialPid(c.word[i]));
+                        if (pids.size() > 1 && num > result.candidates.size()) {
+                            // words of every split ranked together, behind by how much worse their split scored
+                            updateSplits(db, wd);
+                            // dictionary words first among equals
+                            std::vector<Candidate> words;
+                            for (std::size_t j = 0; j < splits.size(); ++j) {
+                                if (walks.size() <= j) {
+                                    walks.emplace_back(wd);
+                                }
+                                addWords(wd, walks[j], splits[j], num - result.candidates.size(), words);
+                                if (custom) {
+                                    if (customWalks.size() <= j) {
+                                        customWalks.emplace_back(*custom);
+                                    }
+                                    addWords(*custom, customWalks[j], splits[j], num - result.candidates.size(), words);
                                 }
-                                result.candidates.push_back({utf32toC(c.word), enggy, c.score, byteIndices[std::min(pids.size() - 1, byteIndices.size() - 1)]});
                             }
-                        }
-                        if (num > result.candidates.size()) {
-                            for (auto c: im.pinyinCharCandidates(db, prefixUtf32, pids.front(), num - result.candidates.size())) {
-                                auto enggy = ed.charToEnggy(c.character, pids.front());
-                                result.candidates.push_back({utf32toC(c.character), enggy, c.score, byteIndices[0]});
+                            std::stable_sort(words.begin(), words.end(), [] (Candidate const &a, Candidate const &b) {
+                                return a.score > b.score;
+                            });
+                            // a word found by several splits keeps its best
+                            for (auto &c: words) {
+                                if (num <= result.candidates.size()) {
+                                    break;
+                                }
+                                if (std::none_of(result.candidates.begin(), result.candidates.end(), [&] (Candidate const &x) { return x.text == c.text; })) {
+                                    result.candidates.push_back(std::move(c));
+                                }
                             }
-                        }
-                    } }
+                            if (num > result.candidates.size()) {
+                                for (auto c: im.pinyinCharCandidates(db, prefixOccurance(im), pids.front(), num - result.candidates.size())) {
+                                    auto enggy = ed.charToEnggy(c.character, pids.front());
+                                    result.candidates.push_back({utf32toC(c.character), enggy, c.score, byteIndices[0]});
+                                }
+                            }
+                        } }
+                }
+            }
+            return result;
+        }
+
+        // forget the cached state and the pinned layer, e.g. to free them while the user is idle
+        void reset() {
+            layer.reset();
+            restUtf32.clear();
+            restPids.clear();
+            restIndices.clear();
+            restByteIndices.clear();
+            checkpoints.clear();
+            prefixUtf8.clear();
+            prefixUtf32.clear();
+            prefixFraction = {0, 0};
+            hasOccurance = false;
+            restBytes.clear();
+            splits.clear();
+            hasSplits = false;
+            lattice = PinyinLattice(false, U'0');
+            walks.clear();
+            customWalks.clear();
+        }
+
+    private:
+        // a segmentation of the rest of the input, words are looked up for each
+        struct Split {
+            std::vector<Pid> pids;
+            std::vector<std::size_t> byteIndices; // utf-8 end of each pid in the rest
+            double penalty;                       // lattice score behind the best segmentation
+        };
+
+        static constexpr std::size_t kNumSplits = 4;
+
+        std::shared_ptr<PinyinOverlay> overlay;
+        std::shared_ptr<PinyinOverlay::Layer const> layer; // pinned with the dictionary and custom words it holds
+        std::uint64_t layerVersion = 0;
+        std::u32string restUtf32;
+        std::vector<Pid> restPids;
+        std::vector<std::size_t> restIndices;
+        std::vector<std::size_t> restByteIndices;
+        std::vector<std::size_t> restBytes;
+        std::vector<PinyinDB::SplitCheckpoint> checkpoints;
+        std::vector<Split> splits;
+        bool hasSplits = false;
+        PinyinLattice lattice{false, U'0'}; // over restUtf32, updated from its first changed char
+        std::string prefixUtf8;
+        std::u32string prefixUtf32;
+        std::pair<int, int> prefixFraction{0, 0};
+        bool hasOccurance = false;
+        std::unordered_map<char32_t, double> occurance;
+        std::vector<TrieWalk<PinyinWordsDB, Pid>> walks;       // one per split, into the dictionary words
+        std::vector<TrieWalk<PinyinWordsDB, Pid>> customWalks; // one per split, into the custom words
+
+        // load the current layer, dropping the state built from the parts of the old one it replaces
+        void pin(std::uint64_t version) {
+            auto next = overlay->layer();
+            if (!next->dict) [[unlikely]] {
+                throw std::invalid_argument("PinyinOverlay not registered with a PinyinServer");
+            }
+            if (!layer || next->dict != layer->dict) {
+                reset();
+            } else {
+                if (next->customWords != layer->customWords) {
+                    customWalks.clear();
+                }
+                if (next->im != layer->im) {
+                    hasOccurance = false;
+                }
             }
+            layer = std::move(next);
+            layerVersion = version;
         }
-        return result;
+
+        void updatePrefix(std::string const &prefix) {
+            if (prefix == prefixUtf8) {
+                return;
+            }
+            prefixUtf8 = prefix;
+            prefixUtf32 = utfCto32(prefix);
+            prefixFraction = chineseEnglishFraction(prefixUtf32);
+            hasOccurance = false;
+        }
+
+        std::unordered_map<char32_t, double> const &prefixOccurance(PinyinInput const &im) {
+            if (!hasOccurance) {
+                occurance = im.prefixCharOccurances(prefixUtf32);
+                hasOccurance = true;
+            }
+            return occurance;
+        }
+
+        void updateRest(PinyinDB const &db, std::u32string rest) {
+            if (rest == restUtf32) {
+                return;
+            }
+            auto common = static_cast<std::size_t>(std::mismatch(rest.begin(), rest.end(), restUtf32.begin(), restUtf32.end()).first - rest.begin());
+            // the last checkpoint whose pids before it are decided by unchanged chars only
+            std::size_t keep = checkpoints.size();
+            while (keep > 0 && checkpoints[keep - 1].position + 2 > common) {
+                --keep;
+            }
+            std::size_t position = 0;
+            if (keep > 0) {
+                --keep;
+                position = checkpoints[keep].position;
+                restPids.resize(checkpoints[keep].numPids);
+                restIndices.resize(checkpoints[keep].numPids);
+            } else {
+                restPids.clear();
+                restIndices.clear();
+            }
+            checkpoints.resize(keep);
+            std::size_t numPids = restPids.size();
+            std::vector<std::size_t> indices;
+            std::vector<PinyinDB::SplitCheckpoint> tail;
+            db.pinyinSplit(std::u32string_view(rest).substr(position), std::back_inserter(restPids), false, U'0',
+                                  std::back_inserter(indices), std::back_inserter(tail));
+            for (auto i : indices) {
+                restIndices.push_back(position + i);
+            }
+            for (auto const &checkpoint : tail) {
+                checkpoints.push_back({position + checkpoint.position, numPids + checkpoint.numPids});
+            }
+            restUtf32 = std::move(rest);
+            hasSplits = false;
+            // byte length of each utf-8 prefix of rest, same as utf32toC(rest.substr(0, i)).size()
+            restBytes.assign(restUtf32.size() + 1, 0);
+            for (std::size_t i = 0; i < restUtf32.size(); ++i) {
+                char32_t c = restUtf32[i];
+                restBytes[i + 1] = restBytes[i] + (c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : c < 0x200000 ? 4 : 0);
+            }
+            restByteIndices.clear();
+            for (auto i : restIndices) {
+                restByteIndices.push_back(restBytes[i]);
+            }
+        }
+
+        // the split of pinyinSplit first, then the other best segmentations of the lattice with two or more
+        // pids, built once per rest
+        void updateSplits(PinyinDB const &db, PinyinWordsDB const &wd) {
+            if (hasSplits) {
+                return;
+            }
+            splits.clear();
+            splits.push_back({restPids, restByteIndices, 0.0});
+            lattice.update(db, &wd, restUtf32);
+            auto paths = lattice.kBest(kNumSplits);
+            for (auto &path : paths) {
+                if (path.pids.size() < 2 || path.pids == restPids) {
+                    continue;
+                }
+                std::vector<std::size_t> byteIndices;
+                for (auto i : path.indices) {
+                    byteIndices.push_back(restBytes[i]);
+                }
+                splits.push_back({std::move(path.pids), std::move(byteIndices), paths.front().score - path.score});
+            }
+            hasSplits = true;
+        }
+    };
+
+    Session session() {
+        return Session(*this);
+    }
+
+    Session session(std::shared_ptr<PinyinOverlay> overlay) {
+        return Session(*this, std::move(overlay));
+    }
+
+    InputResult onInput(std::string const &prefix, std::string const &in, std::size_t num = 100) {
+        return Session(*this).onInput(prefix, in, num);
+    }
+
+    // overlay must be registered, as for session(overlay)
+    InputResult onInput(std::shared_ptr<PinyinOverlay> overlay, std::string const &prefix, std::string const &in, std::size_t num = 100) {
+        return Session(*this, std::move(overlay)).onInput(prefix, in, num);
     }
 };
 
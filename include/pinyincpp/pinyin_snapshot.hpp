@@ -0,0 +1,486 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+#include <pinyincpp/bytes_reader.hpp>
+#include <pinyincpp/crc32.hpp>
+
+namespace pinyincpp {
+
+struct PinyinCharInfo {
+    char32_t character;
+    float logFrequency;
+    auto tuplify() const { return std::tie(character, logFrequency); }
+};
+
+// versioned, position-independent image of the PinyinDB tables
+// all sections are flat arrays addressed by offsets, so the image can be mmap-ed read-only and queried in place
+struct PinyinSnapshot {
+    static constexpr char kMagic[8] = {'P', 'Y', 'C', 'P', 'P', 'D', 'B', '\0'};
+    static constexpr std::uint32_t kVersion = 4;
+    static constexpr std::uint32_t kByteOrderMark = 0x01020304;
+    static constexpr std::size_t kNameSize = 8;
+    static constexpr std::uint32_t kPageBits = 8;
+    static constexpr std::uint32_t kPageSize = 1u << kPageBits;
+    static constexpr std::uint32_t kNumPages = 0x110000 >> kPageBits;
+
+    enum Section : std::uint32_t {
+        kPinyinNames,       // char[kNameSize] per pid, zero padded
+        kPinyinOrder,       // u32 pid, sorted by name
+        kSyllableStates,    // SyllableState, trie automaton over the a-z pinyin names, state 0 is the root
+        kCharKeys,          // char32_t, sorted
+        kCharFrequencies,   // float per char
+        kCharToneOffsets,   // u32 per char + 1, ranges into kPidTones
+        kPidTones,          // u16 per reading, packed as pid << 3 | tone
+        kPinyinCharOffsets, // u32 per pid + 1, ranges into kPinyinChars
+        kPinyinChars,       // PinyinCharInfo, chars of each pid in data order
+        kCharPages,         // u32 per kPageSize code points, block of kCharSlots, block 0 has no chars
+        kCharSlots,         // u32 index into kCharKeys per code point of each block, npos if none
+        kCharPidOffsets,    // u32 per char + 1, ranges into kCharPids
+        kCharPids,          // i32 distinct pids of each char in reading order
+        kNumSections,
+    };
+
+    // one state per distinct prefix of the pinyin names, next[c - 'a'] is 0 when the prefix cannot be extended by c
+    struct SyllableState {
+        std::uint16_t next[26];
+        std::int16_t pid;      // pid of the name spelled by this state, -1 if none
+        std::uint16_t parent;
+        std::uint8_t depth;
+        char last;             // last char of the spelled prefix
+        char reserved[6];
+    };
+
+    static constexpr std::size_t kSectionElementSize[kNumSections] = {
+        kNameSize, 4, sizeof(SyllableState), 4, 4, 4, 2, 4, sizeof(PinyinCharInfo), 4, 4, 4, 4,
+    };
+
+    struct SectionEntry {
+        std::uint32_t offset;
+        std::uint32_t count;
+    };
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byteOrder;
+        std::uint32_t totalSize;
+        std::uint32_t numSections;
+        SectionEntry sections[kNumSections];
+        std::uint32_t checksum; // crc32 of the image with this field and the padding after it left out
+        std::uint32_t reserved;
+    };
+
+    static_assert(sizeof(PinyinCharInfo) == 8);
+    static_assert(sizeof(SyllableState) == 64);
+    static_assert(sizeof(Header) % 4 == 0);
+
+private:
+    const char *base = nullptr;
+    Header const *header = nullptr;
+
+    template <class T>
+    T const *section(Section s) const noexcept {
+        return reinterpret_cast<T const *>(base + header->sections[s].offset);
+    }
+
+    std::uint32_t count(Section s) const noexcept {
+        return header->sections[s].count;
+    }
+
+    static std::string_view nameView(const char *name) noexcept {
+        return {name, static_cast<std::size_t>(std::find(name, name + kNameSize, '\0') - name)};
+    }
+
+    static bool nameLess(const char *lhs, std::string_view rhs) noexcept {
+        return nameView(lhs) < rhs;
+    }
+
+public:
+    PinyinSnapshot() noexcept = default;
+
+    // checksum of the first totalSize bytes of an image
+    static std::uint32_t checksum(std::string_view image) noexcept {
+        auto crc = crc32(image.substr(0, offsetof(Header, checksum)));
+        return crc32(image.substr(sizeof(Header)), crc);
+    }
+
+    // validates the image and returns a view into it, the bytes must outlive the view; the checksum reads
+    // every page of the image, so it may be skipped for images built by this process or baked in the binary
+    static PinyinSnapshot open(std::string_view bytes, bool verifyChecksum = true) {
+        if (bytes.size() < sizeof(Header) || reinterpret_cast<std::uintptr_t>(bytes.data()) % 4 != 0) [[unlikely]] {
+            throw std::runtime_error("PinyinSnapshot image truncated or misaligned");
+        }
+        PinyinSnapshot snap;
+        snap.base = bytes.data();
+        snap.header = reinterpret_cast<Header const *>(bytes.data());
+        auto const &h = *snap.header;
+        if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0) [[unlikely]] {
+            throw std::runtime_error("PinyinSnapshot bad magic");
+        }
+        if (h.byteOrder != kByteOrderMark) [[unlikely]] {
+            throw std::runtime_error("PinyinSnapshot byte order mismatch");
+        }
+        if (h.version != kVersion || h.numSections != kNumSections) [[unlikely]] {
+            throw std::runtime_error("PinyinSnapshot version mismatch");
+        }
+        if (h.totalSize > bytes.size()) [[unlikely]] {
+            throw std::runtime_error("PinyinSnapshot image truncated");
+        }
+        if (verifyChecksum && checksum(bytes.substr(0, h.totalSize)) != h.checksum) [[unlikely]] {
+            throw std::runtime_error("PinyinSnapshot checksum mismatch");
+        }
+        for (std::uint32_t s = 0; s < kNumSections; ++s) {
+            auto const &e = h.sections[s];
+            if (e.offset % 4 != 0 || e.offset < sizeof(Header) || e.offset > h.totalSize
+                || (std::uint64_t)e.count * kSectionElementSize[s] > h.totalSize - e.offset) [[unlikely]] {
+                throw std::runtime_error("PinyinSnapshot section out of range");
+            }
+        }
+        // offsets must start at 0, never decrease and end within the items, so every row is a valid range
+        auto csrValid = [&] (Section offsets, Section rows, Section items) {
+            if (snap.count(offsets) != snap.count(rows) + 1) {
+                return false;
+            }
+            auto first = snap.section<std::uint32_t>(offsets);
+            auto last = first + snap.count(offsets);
+            return first[0] == 0 && std::is_sorted(first, last) && last[-1] <= snap.count(items);
+        };
+        if (!csrValid(kCharToneOffsets, kCharKeys, kPidTones)
+            || !csrValid(kPinyinCharOffsets, kPinyinNames, kPinyinChars)
+            || !csrValid(kCharPidOffsets, kCharKeys, kCharPids)
+            || snap.count(kCharPages) != kNumPages
+            || snap.count(kCharSlots) == 0 || snap.count(kCharSlots) % kPageSize != 0
+            || snap.count(kCharFrequencies) != snap.count(kCharKeys)
+            || snap.count(kPinyinOrder) != snap.count(kPinyinNames)
+            || snap.count(kSyllableStates) == 0) [[unlikely]] {
+            throw std::runtime_error("PinyinSnapshot inconsistent sections");
+        }
+        auto order = snap.section<std::uint32_t>(kPinyinOrder);
+        auto pidTones = snap.section<std::uint16_t>(kPidTones);
+        auto charPids = snap.section<std::int32_t>(kCharPids);
+        if (!std::all_of(order, order + snap.count(kPinyinOrder), [&] (std::uint32_t pid) {
+            return pid < snap.numPinyins();
+        }) || !std::all_of(pidTones, pidTones + snap.count(kPidTones), [&] (std::uint16_t pidTone) {
+            return (std::uint32_t)(pidTone >> 3) < snap.numPinyins();
+        }) || !std::all_of(charPids, charPids + snap.count(kCharPids), [&] (std::int32_t pid) {
+            return pid >= 0 && (std::uint32_t)pid < snap.numPinyins();
+        })) [[unlikely]] {
+            throw std::runtime_error("PinyinSnapshot pid out of range");
+        }
+        auto states = snap.section<SyllableState>(kSyllableStates);
+        for (std::uint32_t i = 0; i < snap.count(kSyllableStates); ++i) {
+            auto const &state = states[i];
+            bool valid = state.parent < snap.count(kSyllableStates) && state.pid < (std::int32_t)snap.numPinyins()
+                && state.depth < kNameSize;
+            for (auto next : state.next) {
+                valid = valid && next < snap.count(kSyllableStates);
+            }
+            if (!valid) [[unlikely]] {
+                throw std::runtime_error("PinyinSnapshot syllable automaton out of range");
+            }
+        }
+        auto pages = snap.section<std::uint32_t>(kCharPages);
+        auto slots = snap.section<std::uint32_t>(kCharSlots);
+        if (!std::all_of(pages, pages + kNumPages, [&] (std::uint32_t block) {
+            return block < snap.count(kCharSlots) / kPageSize;
+        }) || !std::all_of(slots, slots + snap.count(kCharSlots), [&] (std::uint32_t index) {
+            return index < snap.count(kCharKeys) || index == npos;
+        })) [[unlikely]] {
+            throw std::runtime_error("PinyinSnapshot char page table out of range");
+        }
+        return snap;
+    }
+
+    explicit operator bool() const noexcept {
+        return header != nullptr;
+    }
+
+    std::string_view bytes() const noexcept {
+        return {base, header->totalSize};
+    }
+
+    std::uint32_t numPinyins() const noexcept {
+        return count(kPinyinNames);
+    }
+
+    std::string_view pinyinName(std::uint32_t pid) const noexcept {
+        return nameView(section<char>(kPinyinNames) + pid * kNameSize);
+    }
+
+    // returns -1 if not found
+    std::int32_t findPinyin(std::string_view name) const noexcept {
+        auto order = section<std::uint32_t>(kPinyinOrder);
+        auto names = section<char>(kPinyinNames);
+        auto it = std::lower_bound(order, order + count(kPinyinOrder), name, [names] (std::uint32_t pid, std::string_view name) {
+            return nameLess(names + pid * kNameSize, name);
+        });
+        if (it == order + count(kPinyinOrder) || pinyinName(*it) != name) {
+            return -1;
+        }
+        return static_cast<std::int32_t>(*it);
+    }
+
+    // state reached from state by appending c, 0 if c is not a-z or no pinyin has that prefix
+    std::uint32_t syllableNext(std::uint32_t state, char32_t c) const noexcept {
+        if (c < 'a' || c > 'z') [[unlikely]] {
+            return 0;
+        }
+        return section<SyllableState>(kSyllableStates)[state].next[c - 'a'];
+    }
+
+    SyllableState const &syllableState(std::uint32_t state) const noexcept {
+        return section<SyllableState>(kSyllableStates)[state];
+    }
+
+    bool isPinyinPrefix(std::string_view prefix) const noexcept {
+        std::uint32_t state = 0;
+        for (char c : prefix) {
+            if (!(state = syllableNext(state, (unsigned char)c))) {
+                return false;
+            }
+        }
+        return state != 0;
+    }
+
+    static constexpr std::uint32_t npos = (std::uint32_t)-1;
+
+    // two array loads through the page table, pages without chars share the empty block 0
+    std::uint32_t findChar(char32_t c) const noexcept {
+        if (c >= kNumPages << kPageBits) [[unlikely]] {
+            return npos;
+        }
+        auto block = section<std::uint32_t>(kCharPages)[c >> kPageBits];
+        return section<std::uint32_t>(kCharSlots)[block << kPageBits | (c & (kPageSize - 1))];
+    }
+
+    float charFrequency(std::uint32_t index) const noexcept {
+        return section<float>(kCharFrequencies)[index];
+    }
+
+    std::span<std::uint16_t const> charPidTones(std::uint32_t index) const noexcept {
+        auto offsets = section<std::uint32_t>(kCharToneOffsets);
+        return {section<std::uint16_t>(kPidTones) + offsets[index], section<std::uint16_t>(kPidTones) + offsets[index + 1]};
+    }
+
+    // pids of charPidTones without repeats, e.g. of the same pid in several tones
+    std::span<std::int32_t const> charPids(std::uint32_t index) const noexcept {
+        auto offsets = section<std::uint32_t>(kCharPidOffsets);
+        return {section<std::int32_t>(kCharPids) + offsets[index], section<std::int32_t>(kCharPids) + offsets[index + 1]};
+    }
+
+    std::span<PinyinCharInfo const> pinyinChars(std::uint32_t pid) const noexcept {
+        if (pid >= numPinyins()) {
+            return {};
+        }
+        auto offsets = section<std::uint32_t>(kPinyinCharOffsets);
+        return {section<PinyinCharInfo>(kPinyinChars) + offsets[pid], section<PinyinCharInfo>(kPinyinChars) + offsets[pid + 1]};
+    }
+
+    // build an image from the data/pinyin.bin format, words are used only to guarantee alignment
+    static std::vector<std::uint32_t> compile(BytesReader f) {
+        struct CharEntry {
+            char32_t character;
+            float logFrequency;
+            std::vector<std::uint16_t> pidTones;
+        };
+
+        std::vector<std::string> names;
+        auto nPids = f.read32();
+        names.reserve(nPids);
+        for (std::uint32_t pid = 0; pid < nPids; ++pid) {
+            auto name = f.reads(6);
+            name.resize(std::strlen(name.c_str()));
+            names.push_back(std::move(name));
+        }
+        std::vector<CharEntry> chars;
+        auto nChars = f.read32();
+        chars.reserve(nChars);
+        for (std::uint32_t i = 0; i < nChars; ++i) {
+            char32_t c = f.read24();
+            double logProb = (double)f.read16() / 4096;
+            auto nPidTones = f.read8();
+            std::vector<std::uint16_t> pidTones;
+            pidTones.reserve(nPidTones);
+            for (std::size_t j = 0; j < nPidTones; ++j) {
+                auto pidTone = f.read16();
+                if ((std::uint32_t)(pidTone >> 3) >= nPids) [[unlikely]] {
+                    throw std::runtime_error("PinyinSnapshot pid out of range");
+                }
+                pidTones.push_back(pidTone);
+            }
+            chars.push_back({c, static_cast<float>(logProb), std::move(pidTones)});
+        }
+
+        std::vector<std::uint32_t> order(names.size());
+        for (std::uint32_t pid = 0; pid < order.size(); ++pid) {
+            order[pid] = pid;
+        }
+        std::stable_sort(order.begin(), order.end(), [&] (std::uint32_t a, std::uint32_t b) {
+            return names[a] < names[b];
+        });
+
+        std::vector<SyllableState> states(1);
+        for (std::uint32_t pid = 0; pid < names.size(); ++pid) {
+            std::uint32_t state = 0;
+            for (char c : names[pid]) {
+                if (c < 'a' || c > 'z') [[unlikely]] {
+                    throw std::runtime_error("PinyinSnapshot pinyin name not in a-z");
+                }
+                if (!states[state].next[c - 'a']) {
+                    if (states.size() > 0xffff) [[unlikely]] {
+                        throw std::runtime_error("PinyinSnapshot too many syllable states");
+                    }
+                    auto &child = states.emplace_back();
+                    child.pid = -1;
+                    child.parent = state;
+                    child.depth = states[state].depth + 1;
+                    child.last = c;
+                    states[state].next[c - 'a'] = states.size() - 1;
+                }
+                state = states[state].next[c - 'a'];
+            }
+            if (pid > 0x7fff) [[unlikely]] {
+                throw std::runtime_error("PinyinSnapshot too many pinyins");
+            }
+            if (state && states[state].pid < 0) {
+                states[state].pid = pid;
+            }
+        }
+        states[0].pid = -1;
+
+        // chars of each pid keep data order, each char listed once per distinct pid
+        std::vector<std::vector<PinyinCharInfo>> pinyinChars(names.size());
+        for (auto const &c : chars) {
+            std::vector<std::uint32_t> added;
+            for (auto pidTone : c.pidTones) {
+                std::uint32_t pid = pidTone >> 3;
+                if (pid < names.size() && std::find(added.begin(), added.end(), pid) == added.end()) {
+                    added.push_back(pid);
+                    pinyinChars[pid].push_back({c.character, c.logFrequency});
+                }
+            }
+        }
+
+        // duplicated chars merge their readings, the last frequency wins
+        std::vector<std::size_t> charOrder(chars.size());
+        for (std::size_t i = 0; i < charOrder.size(); ++i) {
+            charOrder[i] = i;
+        }
+        std::stable_sort(charOrder.begin(), charOrder.end(), [&] (std::size_t a, std::size_t b) {
+            return chars[a].character < chars[b].character;
+        });
+        std::vector<char32_t> charKeys;
+        std::vector<float> charFrequencies;
+        std::vector<std::uint32_t> charToneOffsets;
+        std::vector<std::uint16_t> pidTones;
+        for (std::size_t i : charOrder) {
+            auto const &c = chars[i];
+            if (charKeys.empty() || charKeys.back() != c.character) {
+                charKeys.push_back(c.character);
+                charFrequencies.push_back(c.logFrequency);
+                charToneOffsets.push_back(pidTones.size());
+            } else {
+                charFrequencies.back() = c.logFrequency;
+            }
+            pidTones.insert(pidTones.end(), c.pidTones.begin(), c.pidTones.end());
+        }
+        charToneOffsets.push_back(pidTones.size());
+
+        std::vector<std::uint32_t> charPages(kNumPages, 0);
+        std::vector<std::uint32_t> charSlots(kPageSize, npos);
+        std::vector<std::uint32_t> charPidOffsets;
+        std::vector<std::int32_t> charPids;
+        for (std::uint32_t i = 0; i < charKeys.size(); ++i) {
+            char32_t c = charKeys[i];
+            if (c >= kNumPages << kPageBits) [[unlikely]] {
+                throw std::runtime_error("PinyinSnapshot char out of unicode range");
+            }
+            auto &block = charPages[c >> kPageBits];
+            if (!block) {
+                block = charSlots.size() / kPageSize;
+                charSlots.resize(charSlots.size() + kPageSize, npos);
+            }
+            charSlots[block << kPageBits | (c & (kPageSize - 1))] = i;
+            charPidOffsets.push_back(charPids.size());
+            auto first = charPids.size();
+            for (std::uint32_t t = charToneOffsets[i]; t < charToneOffsets[i + 1]; ++t) {
+                std::int32_t pid = pidTones[t] >> 3;
+                if (std::find(charPids.begin() + first, charPids.end(), pid) == charPids.end()) {
+                    charPids.push_back(pid);
+                }
+            }
+        }
+        charPidOffsets.push_back(charPids.size());
+
+        std::vector<char> out(sizeof(Header));
+        Header header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.byteOrder = kByteOrderMark;
+        header.numSections = kNumSections;
+        auto beginSection = [&] (Section s, std::size_t count) {
+            out.resize((out.size() + 3) / 4 * 4);
+            header.sections[s] = {static_cast<std::uint32_t>(out.size()), static_cast<std::uint32_t>(count)};
+        };
+        auto appendBytes = [&] (const void *data, std::size_t size) {
+            auto p = static_cast<const char *>(data);
+            out.insert(out.end(), p, p + size);
+        };
+        auto appendNames = [&] (Section s, std::vector<std::string> const &list) {
+            beginSection(s, list.size());
+            for (auto const &name : list) {
+                if (name.size() >= kNameSize) [[unlikely]] {
+                    throw std::runtime_error("PinyinSnapshot pinyin name too long");
+                }
+                char buf[kNameSize] = {};
+                std::memcpy(buf, name.data(), name.size());
+                appendBytes(buf, kNameSize);
+            }
+        };
+        auto appendArray = [&] (Section s, auto const &vec) {
+            beginSection(s, vec.size());
+            appendBytes(vec.data(), vec.size() * sizeof(vec[0]));
+        };
+
+        appendNames(kPinyinNames, names);
+        appendArray(kPinyinOrder, order);
+        appendArray(kSyllableStates, states);
+        appendArray(kCharKeys, charKeys);
+        appendArray(kCharFrequencies, charFrequencies);
+        appendArray(kCharToneOffsets, charToneOffsets);
+        appendArray(kPidTones, pidTones);
+        std::vector<std::uint32_t> pinyinCharOffsets;
+        std::vector<PinyinCharInfo> pinyinCharList;
+        for (auto const &list : pinyinChars) {
+            pinyinCharOffsets.push_back(pinyinCharList.size());
+            pinyinCharList.insert(pinyinCharList.end(), list.begin(), list.end());
+        }
+        pinyinCharOffsets.push_back(pinyinCharList.size());
+        appendArray(kPinyinCharOffsets, pinyinCharOffsets);
+        appendArray(kPinyinChars, pinyinCharList);
+        appendArray(kCharPages, charPages);
+        appendArray(kCharSlots, charSlots);
+        appendArray(kCharPidOffsets, charPidOffsets);
+        appendArray(kCharPids, charPids);
+
+        out.resize((out.size() + 3) / 4 * 4);
+        header.totalSize = static_cast<std::uint32_t>(out.size());
+        std::memcpy(out.data(), &header, sizeof(Header));
+        header.checksum = checksum(std::string_view(out.data(), out.size()));
+        std::memcpy(out.data(), &header, sizeof(Header));
+        std::vector<std::uint32_t> words(out.size() / 4);
+        std::memcpy(words.data(), out.data(), out.size());
+        return words;
+    }
+};
+
+}
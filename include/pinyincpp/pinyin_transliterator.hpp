@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <pinyincpp/pinyin_chars.hpp>
+#include <pinyincpp/pinyin_polyphone.hpp>
+
+namespace pinyincpp {
+
+// hanzi to pinyin over utf-8 fed in chunks of any size, a code point split between chunks is carried over,
+// chars without a reading and invalid bytes are copied through, syllables are separated from each other
+// and from the surrounding text by the separator; syllable spellings are built once in the constructor,
+// so converting writes straight into the caller's buffer and allocates nothing per char; with a context,
+// runs of chars with readings are held back and read as a whole by PinyinPolyphone
+struct PinyinTransliterator {
+    enum class ToneStyle {
+        kNone,   // zhong guo
+        kNumber, // zhong1 guo2, neutral tone left out
+        kMark,   // zhōng guó, v written as ü
+    };
+
+    struct Options {
+        ToneStyle tone = ToneStyle::kNone;
+        std::string separator = " ";
+        PinyinPolyphone const *context = nullptr; // first reading of each char if null
+    };
+
+    // many strings converted into one buffer, item i is text[offsets[i], offsets[i + 1])
+    struct Batch {
+        std::string text;
+        std::vector<std::size_t> offsets{0};
+
+        std::size_t size() const noexcept {
+            return offsets.size() - 1;
+        }
+
+        std::string_view operator[](std::size_t i) const noexcept {
+            return std::string_view(text).substr(offsets[i], offsets[i + 1] - offsets[i]);
+        }
+    };
+
+private:
+    static constexpr std::size_t kNumTones = 8;
+    static constexpr std::size_t kMaxRun = 256; // chars held back for the context at most
+
+    PinyinDB const *db;
+    Options options;
+    std::string spellings; // per pid and tone, ranges by spellingOffsets
+    std::vector<std::uint32_t> spellingOffsets;
+    char pending[4];
+    std::uint8_t pendingSize = 0;
+    std::uint8_t pendingNeeded = 0;
+    char32_t codepoint = 0;
+    bool lastWasPinyin = false;
+    bool empty = true;
+    std::u32string run;
+
+    static void appendMarked(std::string &out, std::string_view name, unsigned tone) {
+        static constexpr std::u8string_view kMarks[6][4] = {
+            {u8"ā", u8"á", u8"ǎ", u8"à"},
+            {u8"ē", u8"é", u8"ě", u8"è"},
+            {u8"ī", u8"í", u8"ǐ", u8"ì"},
+            {u8"ō", u8"ó", u8"ǒ", u8"ò"},
+            {u8"ū", u8"ú", u8"ǔ", u8"ù"},
+            {u8"ǖ", u8"ǘ", u8"ǚ", u8"ǜ"},
+        };
+        static constexpr std::string_view kVowels = "aeiouv";
+        // a or e takes the mark, then o of ou, otherwise the last vowel
+        auto at = name.find_first_of("ae");
+        if (at == std::string_view::npos) {
+            at = name.find("ou");
+        }
+        if (at == std::string_view::npos) {
+            at = name.find_last_of(kVowels);
+        }
+        for (std::size_t i = 0; i < name.size(); ++i) {
+            auto v = kVowels.find(name[i]);
+            if (i == at && 1 <= tone && tone <= 4) {
+                auto mark = kMarks[v][tone - 1];
+                out.append(reinterpret_cast<const char *>(mark.data()), mark.size());
+            } else if (name[i] == 'v') {
+                out.append(reinterpret_cast<const char *>(u8"ü"), 2);
+            } else {
+                out.push_back(name[i]);
+            }
+        }
+    }
+
+    std::string_view spelling(Pid pid, unsigned tone) const noexcept {
+        auto i = static_cast<std::size_t>(pid) * kNumTones + tone;
+        return std::string_view(spellings).substr(spellingOffsets[i], spellingOffsets[i + 1] - spellingOffsets[i]);
+    }
+
+    template <class Out>
+    static void write(Out &out, std::string_view bytes) {
+        if constexpr (std::is_same_v<Out, std::string>) {
+            out.append(bytes);
+        } else {
+            out(bytes);
+        }
+    }
+
+    template <class Out>
+    void emitSyllable(Out &out, Pid pid, unsigned tone) {
+        if (!empty) {
+            write(out, options.separator);
+        }
+        write(out, spelling(pid, tone));
+        lastWasPinyin = true;
+        empty = false;
+    }
+
+    template <class Out>
+    void flushRun(Out &out) {
+        if (run.empty()) {
+            return;
+        }
+        auto reading = options.context->bestReading(run);
+        for (std::size_t i = 0; i < reading.pids.size(); ++i) {
+            emitSyllable(out, reading.pids[i], reading.tones[i]);
+        }
+        run.clear();
+    }
+
+    template <class Out>
+    void passThrough(Out &out, std::string_view bytes) {
+        flushRun(out);
+        if (lastWasPinyin) {
+            write(out, options.separator);
+        }
+        write(out, bytes);
+        lastWasPinyin = false;
+        empty = false;
+    }
+
+    // c converted by its first reading or held back for the context, bytes are its utf-8 form
+    template <class Out>
+    void emitChar(Out &out, char32_t c, std::string_view bytes) {
+        auto readings = db->charToPinyinToned(c);
+        if (!readings || readings->empty() || (*readings)[0].pid < 0 || (*readings)[0].pid >= db->pinyinPidLimit()) {
+            passThrough(out, bytes);
+            return;
+        }
+        if (options.context) {
+            run.push_back(c);
+            if (run.size() >= kMaxRun) [[unlikely]] {
+                flushRun(out);
+            }
+            return;
+        }
+        auto first = (*readings)[0];
+        emitSyllable(out, first.pid, first.tone);
+    }
+
+    template <class Out>
+    void flushPending(Out &out) {
+        if (pendingSize) {
+            passThrough(out, std::string_view(pending, pendingSize));
+            pendingSize = pendingNeeded = 0;
+        }
+    }
+
+public:
+    explicit PinyinTransliterator(PinyinDB const &db)
+    : PinyinTransliterator(db, Options()) {
+    }
+
+    PinyinTransliterator(PinyinDB const &db, Options options)
+    : db(&db), options(std::move(options)) {
+        spellingOffsets.reserve(db.pinyinPidLimit() * kNumTones + 1);
+        spellingOffsets.push_back(0);
+        for (Pid pid = 0; pid < db.pinyinPidLimit(); ++pid) {
+            auto name = db.snapshotView().pinyinName(pid);
+            for (unsigned tone = 0; tone < kNumTones; ++tone) {
+                switch (this->options.tone) {
+                case ToneStyle::kNone:
+                    spellings.append(name);
+                    break;
+                case ToneStyle::kNumber:
+                    spellings.append(name);
+                    if (tone) {
+                        spellings.push_back('0' + tone);
+                    }
+                    break;
+                case ToneStyle::kMark:
+                    appendMarked(spellings, name, tone);
+                    break;
+                }
+                spellingOffsets.push_back(spellings.size());
+            }
+        }
+    }
+
+    // convert the next chunk, out is a std::string appended to or a callable taking std::string_view
+    template <class Out>
+    void feed(std::string_view chunk, Out &&out) {
+        auto &sink = out;
+        for (std::size_t i = 0; i < chunk.size(); ++i) {
+            auto byte = static_cast<unsigned char>(chunk[i]);
+            if (pendingNeeded) {
+                if ((byte & 0xC0) == 0x80) {
+                    pending[pendingSize++] = chunk[i];
+                    codepoint = codepoint << 6 | (byte & 0x3F);
+                    if (--pendingNeeded == 0) {
+                        emitChar(sink, codepoint, std::string_view(pending, pendingSize));
+                        pendingSize = 0;
+                    }
+                    continue;
+                }
+                flushPending(sink);
+            }
+            if (byte < 0x80) {
+                // ascii has no readings, a run of it is copied through at once
+                std::size_t j = i + 1;
+                while (j < chunk.size() && static_cast<unsigned char>(chunk[j]) < 0x80) {
+                    ++j;
+                }
+                passThrough(sink, chunk.substr(i, j - i));
+                i = j - 1;
+            } else if (0xC0 <= byte && byte < 0xF8) {
+                pending[0] = chunk[i];
+                pendingSize = 1;
+                pendingNeeded = byte < 0xE0 ? 1 : byte < 0xF0 ? 2 : 3;
+                codepoint = byte & (0x3F >> pendingNeeded);
+            } else {
+                passThrough(sink, chunk.substr(i, 1));
+            }
+        }
+    }
+
+    // end of input: a truncated trailing code point is copied through, the next feed starts a new text
+    template <class Out>
+    void finish(Out &&out) {
+        auto &sink = out;
+        flushPending(sink);
+        flushRun(sink);
+        lastWasPinyin = false;
+        empty = true;
+    }
+
+    std::string transliterate(std::string_view text) {
+        std::string out;
+        feed(text, out);
+        finish(out);
+        return out;
+    }
+
+    // each string converted as a separate text into one flat buffer
+    template <class Strings>
+    Batch transliterateBatch(Strings const &texts) {
+        Batch batch;
+        for (auto const &text : texts) {
+            feed(std::string_view(text), batch.text);
+            finish(batch.text);
+            batch.offsets.push_back(batch.text.size());
+        }
+        return batch;
+    }
+};
+
+}
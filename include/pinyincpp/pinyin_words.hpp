@@ -1,10 +1,19 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <pinyincpp/resources.hpp>
+#include <pinyincpp/crc32.hpp>
+#include <pinyincpp/mapped_file.hpp>
 #include <pinyincpp/utf8.hpp>
 #include <pinyincpp/trie.hpp>
 #include <pinyincpp/pinyin_chars.hpp>
@@ -14,12 +23,137 @@
 namespace pinyincpp {
 
 struct PinyinWordsDB {
+    // a word as viewed in WordTable, valid until the next word is added
     struct WordData {
-        std::u16string word;
-        InlineVector<PidTone, 6> pinyin;
+        std::u16string_view word;
+        std::span<PidTone const> pinyin;
         float score;
     };
 
+    // words as struct of arrays: chars of all words in one pool, pinyin in another with words of
+    // the same pinyin sharing one range of it, and scores in their own array for scans over scores only
+    struct WordTable {
+    private:
+        struct Range {
+            std::uint32_t offset;
+            std::uint32_t size;
+        };
+
+        std::vector<char16_t> chars;
+        std::vector<std::uint32_t> charOffsets{0};
+        std::vector<PidTone> pidTones;
+        std::vector<Range> pinyinRanges;
+        std::vector<float> scores;
+        Range lastPinyin{0, 0};
+
+    public:
+        std::size_t size() const noexcept {
+            return scores.size();
+        }
+
+        WordData operator[](std::size_t i) const noexcept {
+            return {word(i), pinyin(i), scores[i]};
+        }
+
+        std::u16string_view word(std::size_t i) const noexcept {
+            return {chars.data() + charOffsets[i], charOffsets[i + 1] - charOffsets[i]};
+        }
+
+        std::span<PidTone const> pinyin(std::size_t i) const noexcept {
+            return {pidTones.data() + pinyinRanges[i].offset, pinyinRanges[i].size};
+        }
+
+        float score(std::size_t i) const noexcept {
+            return scores[i];
+        }
+
+        void reserve(std::size_t numWords) {
+            charOffsets.reserve(numWords + 1);
+            pinyinRanges.reserve(numWords);
+            scores.reserve(numWords);
+        }
+
+        // start a new pinyin range for the words pushed by pushWord
+        void pushPinyin(std::span<PidTone const> pinyin) {
+            lastPinyin = {static_cast<std::uint32_t>(pidTones.size()), static_cast<std::uint32_t>(pinyin.size())};
+            pidTones.insert(pidTones.end(), pinyin.begin(), pinyin.end());
+        }
+
+        // a word of the last pushPinyin, chars are appended to the pool by appendChars
+        template <class AppendChars>
+        void pushWord(AppendChars &&appendChars, float score) {
+            appendChars(chars);
+            charOffsets.push_back(chars.size());
+            pinyinRanges.push_back(lastPinyin);
+            scores.push_back(score);
+        }
+
+        void push_back(std::u16string_view word, std::span<PidTone const> pinyin, float score) {
+            pushPinyin(pinyin);
+            pushWord([&] (std::vector<char16_t> &pool) {
+                pool.insert(pool.end(), word.begin(), word.end());
+            }, score);
+        }
+
+        void shrink_to_fit() {
+            chars.shrink_to_fit();
+            charOffsets.shrink_to_fit();
+            pidTones.shrink_to_fit();
+            pinyinRanges.shrink_to_fit();
+            scores.shrink_to_fit();
+        }
+    };
+
+    // word text -> word indices, linear probing over word index + 1 (0 for an empty slot) at a load of at most
+    // one half, words of the same text are found in order of index
+    struct TextIndex {
+        std::once_flag once;
+        bool built = false;
+        std::vector<std::uint32_t> slots;
+        std::size_t numWords = 0;
+
+        static std::uint64_t hash(std::u16string_view word) noexcept {
+            std::uint64_t h = 0xcbf29ce484222325ull;
+            for (char16_t c : word) {
+                h = (h ^ c) * 0x100000001b3ull;
+            }
+            return h;
+        }
+
+        void place(WordTable const &table, std::size_t wordIndex) noexcept {
+            std::size_t mask = slots.size() - 1;
+            std::size_t i = hash(table.word(wordIndex)) & mask;
+            while (slots[i]) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = static_cast<std::uint32_t>(wordIndex + 1);
+        }
+
+        void rebuild(WordTable const &table, std::size_t minWords) {
+            std::size_t size = 16;
+            while (size < minWords * 2) {
+                size *= 2;
+            }
+            slots.assign(size, 0);
+            for (std::size_t w = 0; w < numWords; ++w) {
+                place(table, w);
+            }
+        }
+
+        void build(WordTable const &table) {
+            numWords = table.size();
+            rebuild(table, numWords);
+            built = true;
+        }
+
+        void push(WordTable const &table) {
+            if ((numWords + 1) * 2 > slots.size()) {
+                rebuild(table, (numWords + 1) * 2);
+            }
+            place(table, numWords++);
+        }
+    };
+
 #if 0
     template <class, class NodePtr>
     struct TrieKVPair {
@@ -70,43 +204,280 @@ struct PinyinWordsDB {
     static_assert(sizeof(TrieKVPair<Pid, std::unique_ptr<char>>) == 8);
 #endif
 
-    std::vector<WordData> wordData;
+    WordTable wordData;
     TrieMultimap<Pid, std::size_t, InlineVector<Pid, 6>, InlineVector<std::size_t, 3>, TrieKVPair> triePinyinToWord;
 #else
-    std::vector<WordData> wordData;
-    TrieMultimap<Pid, std::size_t, InlineVector<Pid, 6>, InlineVector<std::size_t, 3>> triePinyinToWord;
+    WordTable wordData;
+    FrozenTrieMultimap<Pid, std::size_t> frozenPinyinToWord;
+    TrieMultimap<Pid, std::size_t, InlineVector<Pid, 6>, InlineVector<std::size_t, 3>> triePinyinToWord; // words added since the last freeze()
 #endif
+    std::size_t generation = 0;
+    mutable std::unique_ptr<TextIndex> textIndex = std::make_unique<TextIndex>();
+
+    TextIndex const &wordsByText() const {
+        std::call_once(textIndex->once, [&] {
+            textIndex->build(wordData);
+        });
+        return *textIndex;
+    }
+
+    // data/pinyin-words.bin starts with this header since it is shipped apart from the binary,
+    // the words follow it; files without it are still read from the resources
+    struct WordsHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t size; // bytes of words after the header
+        std::uint32_t checksum; // crc32 of those bytes
+        std::uint32_t reserved;
+    };
+
+    static constexpr char kWordsMagic[8] = {'P', 'Y', 'C', 'P', 'P', 'W', 'D', '\0'};
+    static constexpr std::uint32_t kWordsVersion = 1;
+
+    static_assert(sizeof(WordsHeader) == 24);
+
+    explicit PinyinWordsDB() : PinyinWordsDB(CMakeResource("data/pinyin-words.bin").view(), false) {}
+
+    // reads a words file from memory, the words are copied out so bytes need not outlive the db
+    static PinyinWordsDB loadWords(std::string_view bytes) {
+        return PinyinWordsDB(bytes, true);
+    }
+
+    static PinyinWordsDB openWords(std::string const &path) {
+        MappedFile file(path);
+        return loadWords(file.view());
+    }
 
-    explicit PinyinWordsDB() {
-        BytesReader f = CMakeResource("data/pinyin-words.bin").view();
+    // no words but the ones added by addCustomWords
+    static PinyinWordsDB emptyWords() {
+        return PinyinWordsDB(std::string_view("\0\0\0\0", 4), false);
+    }
+
+private:
+    // every read is bounds checked, as the words may come from a file of any content
+    PinyinWordsDB(std::string_view bytes, bool requireHeader) {
+        if (bytes.size() >= sizeof(WordsHeader) && std::memcmp(bytes.data(), kWordsMagic, sizeof(kWordsMagic)) == 0) {
+            WordsHeader header;
+            std::memcpy(&header, bytes.data(), sizeof(WordsHeader));
+            if (header.version != kWordsVersion) [[unlikely]] {
+                throw std::runtime_error("PinyinWordsDB version mismatch");
+            }
+            if (header.size > bytes.size() - sizeof(WordsHeader)) [[unlikely]] {
+                throw std::runtime_error("PinyinWordsDB words truncated");
+            }
+            bytes = bytes.substr(sizeof(WordsHeader), header.size);
+            if (crc32(bytes) != header.checksum) [[unlikely]] {
+                throw std::runtime_error("PinyinWordsDB checksum mismatch");
+            }
+        } else if (requireHeader) [[unlikely]] {
+            throw std::runtime_error("PinyinWordsDB bad magic");
+        }
+        BytesReader f = bytes;
+        auto need = [&] (std::size_t n) {
+            if (static_cast<std::size_t>(f.end - f.begin) < n) [[unlikely]] {
+                throw std::runtime_error("PinyinWordsDB words truncated");
+            }
+        };
+        need(4);
         auto nWords = f.read32();
-        wordData.reserve(nWords);
+        wordData.reserve(std::min<std::size_t>(nWords, bytes.size()));
+        std::vector<Pid> keyPool;
+        std::vector<std::pair<std::size_t, std::size_t>> keyRanges;
+        keyRanges.reserve(std::min<std::size_t>(nWords, bytes.size()));
+        std::vector<PidTone> pidTones;
         for (std::size_t i = 0; i < nWords; ++i) {
+            need(1);
             auto nPidTones = f.read8();
-            decltype(WordData{}.pinyin) pidTones;
-            InlineVector<Pid, 6> pidUntoned;
-            pidTones.reserve(nPidTones);
-            pidUntoned.reserve(nPidTones);
+            need(nPidTones * 2 + 1);
+            pidTones.clear();
+            std::size_t keyBase = keyPool.size();
             for (std::size_t j = 0; j < nPidTones; ++j) {
                 std::uint16_t pidTone = f.read16();
                 Pid pid = pidTone >> 3;
                 std::uint8_t tone = pidTone & 7;
                 pidTones.push_back({pid, tone});
-                pidUntoned.push_back(pid);
+                keyPool.push_back(pid);
             }
-            std::size_t wordBaseId = wordData.size();
+            wordData.pushPinyin(pidTones);
             auto lenWords = f.read8();
             while (lenWords) {
+                need(lenWords * 2 + 3);
                 double logProb = (double)f.read16() / 2048;
-                auto word = f.reads<std::u16string>(lenWords);
-                wordData.push_back({std::move(word), std::move(pidTones), static_cast<float>(logProb)});
+                wordData.pushWord([&] (std::vector<char16_t> &pool) {
+                    for (std::size_t k = 0; k < lenWords; ++k) {
+                        pool.push_back(f.read16());
+                    }
+                }, static_cast<float>(logProb));
+                keyRanges.emplace_back(keyBase, nPidTones);
                 lenWords = f.read8();
             }
-            triePinyinToWord.batchedInsert(pidUntoned, CountingIterator{wordBaseId}, CountingIterator{wordData.size()});
         }
+        wordData.shrink_to_fit();
+        std::vector<std::pair<std::span<Pid const>, std::size_t>> items;
+        items.reserve(keyRanges.size());
+        for (std::size_t w = 0; w < keyRanges.size(); ++w) {
+            items.emplace_back(std::span<Pid const>(keyPool.data() + keyRanges[w].first, keyRanges[w].second), w);
+        }
+        frozenPinyinToWord = FrozenTrieMultimap<Pid, std::size_t>(std::move(items));
+        annotateScores();
+    }
+
+public:
+    // fold words added since the last freeze() into the compiled trie
+    void freeze() {
+        std::vector<Pid> keyPool;
+        std::vector<std::pair<std::size_t, std::size_t>> keyRanges;
+        std::vector<std::size_t> wordIndices;
+        auto collect = [&] (std::vector<Pid> const &pids, std::size_t const &wordIndex) {
+            keyRanges.emplace_back(keyPool.size(), pids.size());
+            keyPool.insert(keyPool.end(), pids.begin(), pids.end());
+            wordIndices.push_back(wordIndex);
+            return false;
+        };
+        frozenPinyinToWord.visitItems<std::vector<Pid>>(collect);
+        triePinyinToWord.visitItems<std::vector<Pid>>(collect);
+        std::vector<std::pair<std::span<Pid const>, std::size_t>> items;
+        items.reserve(keyRanges.size());
+        for (std::size_t i = 0; i < keyRanges.size(); ++i) {
+            items.emplace_back(std::span<Pid const>(keyPool.data() + keyRanges[i].first, keyRanges[i].second), wordIndices[i]);
+        }
+        frozenPinyinToWord = FrozenTrieMultimap<Pid, std::size_t>(std::move(items));
+        annotateScores();
+        triePinyinToWord = {};
+        ++generation;
+    }
+
+    // changes whenever words are added or the tries rebuilt, which invalidates cursors
+    std::size_t wordsGeneration() const noexcept {
+        return generation;
+    }
+
+    // words spelled exactly word in order of index, visit(wordIndex) may return true to stop; the index by
+    // text is built on the first call, so users who never look words up by text do not pay for it
+    template <class Visit>
+    bool visitWord(std::u16string_view word, Visit &&visit) const {
+        auto const &index = wordsByText();
+        std::size_t mask = index.slots.size() - 1;
+        for (std::size_t i = TextIndex::hash(word) & mask; index.slots[i]; i = (i + 1) & mask) {
+            std::size_t wordIndex = index.slots[i] - 1;
+            if (wordData.word(wordIndex) == word && visit(wordIndex)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::size_t> findWord(std::u16string_view word) const {
+        std::vector<std::size_t> wordIndices;
+        visitWord(word, [&] (std::size_t wordIndex) {
+            wordIndices.push_back(wordIndex);
+            return false;
+        });
+        return wordIndices;
+    }
+
+    template <class Visit>
+    bool visitPrefix(std::vector<Pid> const &pids, Visit &&visit, std::size_t depthLimit = (std::size_t)-1) const {
+        return frozenPinyinToWord.visitPrefix(pids, visit, depthLimit)
+            || triePinyinToWord.visitPrefix(pids, visit, depthLimit);
     }
 
-    void addCustomWords(PinyinDB &db, std::vector<std::pair<std::string, std::string>> const &pinyinAndWords, double effectivity = 0.0) {
+    template <class Visit>
+    bool visitItems(Visit &&visit, std::size_t depthLimit = (std::size_t)-1) const {
+        return frozenPinyinToWord.visitItems<std::vector<Pid>>(visit, depthLimit)
+            || triePinyinToWord.visitItems<std::vector<Pid>>(visit, depthLimit);
+    }
+
+    // cursor into both the compiled trie and the overlay, true while the pinyin of some word starts with the walked pids
+    struct Cursor {
+        decltype(frozenPinyinToWord)::Cursor frozen;
+        decltype(triePinyinToWord)::Cursor overlay;
+
+        explicit operator bool() const noexcept {
+            return frozen || overlay;
+        }
+    };
+
+    Cursor cursor() const noexcept {
+        return {frozenPinyinToWord.cursor(), triePinyinToWord.cursor()};
+    }
+
+    Cursor advance(Cursor cursor, Pid pid) const {
+        return {frozenPinyinToWord.advance(cursor.frozen, pid), triePinyinToWord.advance(cursor.overlay, pid)};
+    }
+
+    // same order as visitPrefix, path holds the pids leading to cursor
+    template <class Visit>
+    bool visitItems(Cursor cursor, std::vector<Pid> &path, Visit &&visit, std::size_t depthLimit = (std::size_t)-1) const {
+        return frozenPinyinToWord.visitItems(cursor.frozen, path, visit, depthLimit)
+            || triePinyinToWord.visitItems(cursor.overlay, path, visit, depthLimit);
+    }
+
+private:
+    void annotateScores() {
+        frozenPinyinToWord.annotate([&] (std::size_t const &wordIndex) {
+            return wordData.score(wordIndex);
+        });
+    }
+
+public:
+
+    // word indices below cursor (at most depthLimit - 1 pids deeper) in non-increasing order of
+    // bound(word score, depth below cursor), see FrozenTrieMultimap::BestFirst, the few overlay words are
+    // merged in by the same key; visit(key, wordIndex, depth, pinyin) may return true to stop, pinyin()
+    // gives the full pids of the word and is only worth calling for the words kept
+    template <class Bound, class Visit>
+    bool visitBestFirst(Cursor cursor, std::vector<Pid> const &path, Bound &&bound, Visit &&visit, std::size_t depthLimit = (std::size_t)-1) const {
+        struct OverlayWord {
+            double key;
+            std::size_t wordIndex;
+            std::size_t depth;
+            std::vector<Pid> pids;
+        };
+        std::vector<OverlayWord> overlay;
+        std::vector<Pid> buffer = path;
+        triePinyinToWord.visitItems(cursor.overlay, buffer, [&] (std::vector<Pid> const &pids, std::size_t const &wordIndex) {
+            overlay.push_back({bound(wordData.score(wordIndex), pids.size() - path.size()), wordIndex, pids.size() - path.size(), pids});
+            return false;
+        }, depthLimit);
+        std::stable_sort(overlay.begin(), overlay.end(), [] (OverlayWord const &a, OverlayWord const &b) {
+            return a.key > b.key;
+        });
+        auto frozenBound = [&] (float score, std::size_t depth) -> double {
+            return bound(score, depth);
+        };
+        typename decltype(frozenPinyinToWord)::template BestFirst<decltype(frozenBound)> frozen(frozenPinyinToWord, cursor.frozen, frozenBound, depthLimit);
+        typename decltype(frozen)::Item item;
+        std::size_t o = 0;
+        while (!frozen.empty() || o < overlay.size()) {
+            if (o < overlay.size() && overlay[o].key > frozen.peek()) {
+                auto const &word = overlay[o++];
+                if (visit(word.key, word.wordIndex, word.depth, [&] { return word.pids; })) {
+                    return true;
+                }
+            } else if (frozen.next(item)) {
+                if (visit(item.key, *item.value, std::size_t(item.depth), [&] {
+                    auto pids = path;
+                    frozen.appendPath(item, pids);
+                    return pids;
+                })) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // whether the pinyin of some word starts with pids
+    bool hasPrefix(std::vector<Pid> const &pids) const {
+        auto c = cursor();
+        for (Pid pid : pids) {
+            c = advance(c, pid);
+        }
+        return static_cast<bool>(c);
+    }
+
+    void addCustomWords(PinyinDB const &db, std::vector<std::pair<std::string, std::string>> const &pinyinAndWords, double effectivity = 0.0) {
         for (auto &[pinyinStr, wordStr]: pinyinAndWords) {
             auto wordUtf32 = utfCto32(wordStr);
             double score = 1;
@@ -118,14 +489,18 @@ struct PinyinWordsDB {
             }
             score /= std::max(1.0, (double)num);
             auto pinyin = db.pinyinSplit(utfCto32(pinyinStr), U' ');
-            decltype(WordData{}.pinyin) pidToned;
+            std::vector<PidTone> pidToned;
             pidToned.reserve(pinyin.size());
             for (auto pid: pinyin) {
                 pidToned.push_back({pid, 0});
             }
             triePinyinToWord.insert(pinyin, wordData.size());
-            wordData.push_back({utf32to16(wordUtf32), std::move(pidToned), static_cast<float>(score * effectivity)});
+            wordData.push_back(utf32to16(wordUtf32), pidToned, static_cast<float>(score * effectivity));
+            if (textIndex->built) {
+                textIndex->push(wordData);
+            }
         }
+        ++generation;
     }
 };
 
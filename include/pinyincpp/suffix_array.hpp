@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace pinyincpp {
+
+// suffix array over a UTF-32 text, the text itself is not owned and must be passed to every query
+struct SuffixArray {
+private:
+    std::vector<std::uint32_t> sa;
+
+    // compare the first pattern.size() chars of the suffix at pos with pattern, the end of text sorts first
+    static int comparePrefix(std::u32string_view text, std::size_t pos, std::u32string_view pattern) noexcept {
+        auto suffix = text.substr(pos, pattern.size());
+        return suffix.compare(pattern);
+    }
+
+public:
+    SuffixArray() = default;
+
+    // prefix doubling with radix sorted rank pairs, O(n log n)
+    explicit SuffixArray(std::u32string_view text) {
+        std::size_t n = text.size();
+        sa.resize(n);
+        if (n == 0) {
+            return;
+        }
+        std::vector<char32_t> alphabet(text.begin(), text.end());
+        std::sort(alphabet.begin(), alphabet.end());
+        alphabet.erase(std::unique(alphabet.begin(), alphabet.end()), alphabet.end());
+        std::vector<std::uint32_t> rank(n), tmp(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            rank[i] = std::lower_bound(alphabet.begin(), alphabet.end(), text[i]) - alphabet.begin();
+        }
+        std::size_t numRanks = alphabet.size();
+        std::vector<std::uint32_t> count(std::max(numRanks, n) + 1);
+        for (std::size_t i = 0; i < n; ++i) {
+            ++count[rank[i]];
+        }
+        for (std::size_t r = 1; r < numRanks; ++r) {
+            count[r] += count[r - 1];
+        }
+        for (std::size_t i = n; i-- > 0;) {
+            sa[--count[rank[i]]] = i;
+        }
+        for (std::size_t k = 1; numRanks < n; k <<= 1) {
+            // order by second key: suffixes shorter than k first, then by the rank of the suffix k chars later
+            std::size_t p = 0;
+            for (std::size_t i = n - std::min(k, n); i < n; ++i) {
+                tmp[p++] = i;
+            }
+            for (std::size_t j = 0; j < n; ++j) {
+                if (sa[j] >= k) {
+                    tmp[p++] = sa[j] - k;
+                }
+            }
+            // stable counting sort by first key
+            std::fill(count.begin(), count.begin() + numRanks, 0);
+            for (std::size_t i = 0; i < n; ++i) {
+                ++count[rank[i]];
+            }
+            for (std::size_t r = 1; r < numRanks; ++r) {
+                count[r] += count[r - 1];
+            }
+            for (std::size_t i = n; i-- > 0;) {
+                sa[--count[rank[tmp[i]]]] = tmp[i];
+            }
+            std::swap(rank, tmp);
+            auto second = [&] (std::uint32_t i) -> std::int64_t {
+                return i + k < n ? (std::int64_t)tmp[i + k] : -1;
+            };
+            rank[sa[0]] = 0;
+            numRanks = 1;
+            for (std::size_t j = 1; j < n; ++j) {
+                bool same = tmp[sa[j - 1]] == tmp[sa[j]] && second(sa[j - 1]) == second(sa[j]);
+                rank[sa[j]] = same ? numRanks - 1 : numRanks++;
+            }
+        }
+    }
+
+    std::size_t size() const noexcept {
+        return sa.size();
+    }
+
+    std::uint32_t operator[](std::size_t i) const noexcept {
+        return sa[i];
+    }
+
+    // range of suffixes starting with pattern
+    std::pair<std::size_t, std::size_t> equalRange(std::u32string_view text, std::u32string_view pattern) const noexcept {
+        auto lo = std::partition_point(sa.begin(), sa.end(), [&] (std::uint32_t pos) {
+            return comparePrefix(text, pos, pattern) < 0;
+        });
+        auto hi = std::partition_point(lo, sa.end(), [&] (std::uint32_t pos) {
+            return comparePrefix(text, pos, pattern) == 0;
+        });
+        return {lo - sa.begin(), hi - sa.begin()};
+    }
+
+    std::size_t countOccurances(std::u32string_view text, std::u32string_view pattern) const noexcept {
+        auto [lo, hi] = equalRange(text, pattern);
+        return hi - lo;
+    }
+
+    // whether two occurrences of pattern may overlap, i.e. pattern has a proper border
+    static bool selfOverlapping(std::u32string_view pattern) {
+        std::vector<std::size_t> fail(pattern.size() + 1);
+        std::size_t k = 0;
+        for (std::size_t i = 1; i < pattern.size(); ++i) {
+            while (k && pattern[i] != pattern[k]) {
+                k = fail[k];
+            }
+            if (pattern[i] == pattern[k]) {
+                ++k;
+            }
+            fail[i + 1] = k;
+        }
+        return !pattern.empty() && fail[pattern.size()] != 0;
+    }
+
+    // ascending positions found by repeating text.find(pattern, pos + pattern.size()), i.e. non-overlapping
+    void findOccurances(std::u32string_view text, std::u32string_view pattern, std::vector<std::size_t> &positions) const {
+        positions.clear();
+        if (pattern.empty()) [[unlikely]] {
+            return;
+        }
+        auto [lo, hi] = equalRange(text, pattern);
+        positions.assign(sa.begin() + lo, sa.begin() + hi);
+        std::sort(positions.begin(), positions.end());
+        if (selfOverlapping(pattern)) {
+            std::size_t next = 0, out = 0;
+            for (std::size_t pos : positions) {
+                if (pos >= next) {
+                    positions[out++] = pos;
+                    next = pos + pattern.size();
+                }
+            }
+            positions.resize(out);
+        }
+    }
+
+    // visit each distinct char following an occurrence of pattern, with its number of occurrences
+    template <class Visit>
+    void visitNextChars(std::u32string_view text, std::u32string_view pattern, Visit &&visit) const {
+        auto [lo, hi] = equalRange(text, pattern);
+        std::size_t m = pattern.size();
+        if (lo < hi && sa[lo] + m == text.size()) {
+            ++lo; // the suffix equal to pattern has no next char and sorts first
+        }
+        while (lo < hi) {
+            char32_t c = text[sa[lo] + m];
+            auto end = std::partition_point(sa.begin() + lo, sa.begin() + hi, [&] (std::uint32_t pos) {
+                return text[pos + m] == c;
+            });
+            std::size_t next = end - sa.begin();
+            visit(c, next - lo);
+            lo = next;
+        }
+    }
+};
+
+}
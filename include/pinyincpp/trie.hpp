@@ -1,12 +1,320 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <stdexcept>
+#include <span>
+#include <utility>
 #include <vector>
 #include <pinyincpp/small_map.hpp>
 #include <pinyincpp/inline_vector.hpp>
 
 namespace pinyincpp {
 
+// read-only trie compiled into contiguous arrays: nodes in BFS order, so the children of a node are one
+// index range whose edge keys are sorted, and the values of each node are one range of a shared array
+template <class K, class V>
+struct FrozenTrieMultimap {
+private:
+    struct Node {
+        std::uint32_t firstChild;
+        std::uint32_t numChildren;
+        std::uint32_t firstValue;
+        std::uint32_t numValues;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<K> keys; // key of the edge leading into each node
+    std::vector<std::uint32_t> parents;
+    std::vector<V> values;
+    // set by annotate(): score of each value and max score of the values below each node
+    std::vector<float> valueScores;
+    std::vector<float> subtreeScores;
+
+    static constexpr std::uint32_t npos = (std::uint32_t)-1;
+
+    std::uint32_t child(std::uint32_t node, K const &key) const {
+        auto first = keys.begin() + nodes[node].firstChild;
+        auto last = first + nodes[node].numChildren;
+        auto it = std::lower_bound(first, last, key);
+        if (it == last || *it != key) {
+            return npos;
+        }
+        return static_cast<std::uint32_t>(it - keys.begin());
+    }
+
+public:
+    FrozenTrieMultimap() : nodes{Node{}}, keys(1), parents{npos} {}
+
+    // items are (key sequence, value) pairs, values sharing a key keep their relative order
+    template <class Items>
+    explicit FrozenTrieMultimap(Items items) {
+        std::stable_sort(items.begin(), items.end(), [] (auto const &a, auto const &b) {
+            return std::lexicographical_compare(a.first.begin(), a.first.end(), b.first.begin(), b.first.end());
+        });
+        struct Pending {
+            std::size_t lo, hi, depth;
+        };
+        std::vector<Pending> pending;
+        nodes.push_back({});
+        keys.emplace_back();
+        parents.push_back(npos);
+        pending.push_back({0, items.size(), 0});
+        values.reserve(items.size());
+        for (std::size_t n = 0; n < pending.size(); ++n) {
+            auto [lo, hi, depth] = pending[n];
+            nodes[n].firstValue = values.size();
+            for (; lo < hi && items[lo].first.size() == depth; ++lo) {
+                values.push_back(items[lo].second);
+            }
+            nodes[n].numValues = values.size() - nodes[n].firstValue;
+            nodes[n].firstChild = nodes.size();
+            while (lo < hi) {
+                K key = items[lo].first[depth];
+                std::size_t mid = lo + 1;
+                while (mid < hi && items[mid].first[depth] == key) {
+                    ++mid;
+                }
+                nodes.push_back({});
+                keys.push_back(key);
+                parents.push_back(n);
+                pending.push_back({lo, mid, depth + 1});
+                lo = mid;
+            }
+            nodes[n].numChildren = nodes.size() - nodes[n].firstChild;
+        }
+        nodes.shrink_to_fit();
+        keys.shrink_to_fit();
+        parents.shrink_to_fit();
+    }
+
+    std::size_t numNodes() const noexcept {
+        return nodes.size();
+    }
+
+    std::size_t numValues() const noexcept {
+        return values.size();
+    }
+
+    // node reached by walking some key sequence, invalid once the walk left the trie,
+    // cursors are plain values, so keep the cursor of a shorter prefix to rewind to it
+    struct Cursor {
+        std::uint32_t node = npos;
+        std::uint32_t depth = 0;
+
+        explicit operator bool() const noexcept {
+            return node != npos;
+        }
+    };
+
+    Cursor cursor() const noexcept {
+        return {0, 0};
+    }
+
+    Cursor advance(Cursor cursor, K const &key) const {
+        if (!cursor) [[unlikely]] {
+            return cursor;
+        }
+        auto next = child(cursor.node, key);
+        return next == npos ? Cursor{} : Cursor{next, cursor.depth + 1};
+    }
+
+    std::span<V const> valuesAt(Cursor cursor) const {
+        if (!cursor) [[unlikely]] {
+            return {};
+        }
+        return {values.data() + nodes[cursor.node].firstValue, nodes[cursor.node].numValues};
+    }
+
+    // visit the items below cursor, path holds the keys leading to it and is the dfs buffer, restored on return
+    template <class Kss, class Visit>
+    bool visitItems(Cursor cursor, Kss &path, Visit &&visit, std::size_t depthLimit = (std::size_t)-1) const {
+        if (!cursor) [[unlikely]] {
+            return false;
+        }
+        return visitItems(cursor.node, path, visit, depthLimit);
+    }
+
+    // score every value for BestFirst, children come after their parent in BFS order,
+    // so one backward pass folds the max of each subtree into its parent
+    template <class Score>
+    void annotate(Score &&score) {
+        valueScores.resize(values.size());
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            valueScores[i] = score(std::as_const(values[i]));
+        }
+        subtreeScores.assign(nodes.size(), -std::numeric_limits<float>::infinity());
+        for (std::size_t n = nodes.size(); n-- > 0;) {
+            auto const &node = nodes[n];
+            for (std::uint32_t i = node.firstValue; i < node.firstValue + node.numValues; ++i) {
+                subtreeScores[n] = std::max(subtreeScores[n], valueScores[i]);
+            }
+            if (parents[n] != npos) {
+                subtreeScores[parents[n]] = std::max(subtreeScores[parents[n]], subtreeScores[n]);
+            }
+        }
+    }
+
+    bool annotated() const noexcept {
+        return subtreeScores.size() == nodes.size();
+    }
+
+    // values below a cursor in non-increasing order of bound(score, depth), score is the annotated score
+    // of a value or max of a subtree and depth is counted from the cursor; bound must not decrease with
+    // score nor increase with depth, so the key of each value bounds the keys of all values after it
+    // and a top-k search stops once that key cannot beat its k-th best, without touching the rest
+    template <class Bound>
+    struct BestFirst {
+        struct Item {
+            V const *value;
+            std::uint32_t node;
+            std::uint32_t depth;
+            double key;
+        };
+
+        BestFirst(FrozenTrieMultimap const &trie, Cursor cursor, Bound bound, std::size_t depthLimit = (std::size_t)-1)
+        : trie(&trie), start(cursor), bound(std::move(bound)), depthLimit(depthLimit) {
+            if (!trie.annotated()) [[unlikely]] {
+                throw std::runtime_error("FrozenTrieMultimap::BestFirst on a trie without annotate()");
+            }
+            if (cursor && depthLimit > 0) {
+                push({this->bound(trie.subtreeScores[cursor.node], std::size_t(0)), cursor.node, 0, false});
+            }
+        }
+
+        bool empty() const noexcept {
+            return heap.empty();
+        }
+
+        // bound of every value not returned yet
+        double peek() const noexcept {
+            return heap.empty() ? -std::numeric_limits<double>::infinity() : heap.front().key;
+        }
+
+        bool next(Item &item) {
+            while (!heap.empty()) {
+                std::pop_heap(heap.begin(), heap.end(), lower);
+                auto entry = heap.back();
+                heap.pop_back();
+                if (entry.isValue) {
+                    item = {&trie->values[entry.index], entry.node, entry.depth, entry.key};
+                    return true;
+                }
+                auto const &node = trie->nodes[entry.index];
+                for (std::uint32_t i = node.firstValue; i < node.firstValue + node.numValues; ++i) {
+                    push({bound(trie->valueScores[i], std::size_t(entry.depth)), i, entry.depth, true, entry.index});
+                }
+                if (entry.depth + 1 < depthLimit) {
+                    for (std::uint32_t c = node.firstChild; c < node.firstChild + node.numChildren; ++c) {
+                        push({bound(trie->subtreeScores[c], std::size_t(entry.depth + 1)), c, entry.depth + 1, false});
+                    }
+                }
+            }
+            return false;
+        }
+
+        // append the keys leading from the cursor to the node of item
+        template <class Kss>
+        void appendPath(Item const &item, Kss &path) const {
+            auto size = path.size();
+            for (auto n = item.node; n != start.node; n = trie->parents[n]) {
+                path.push_back(trie->keys[n]);
+            }
+            std::reverse(path.begin() + size, path.end());
+        }
+
+    private:
+        struct Entry {
+            double key;
+            std::uint32_t index; // of a node, or of a value when isValue
+            std::uint32_t depth;
+            bool isValue;
+            std::uint32_t node = npos;
+        };
+
+        // values before nodes and lower indices first among equal keys, so the order is deterministic
+        static bool lower(Entry const &a, Entry const &b) noexcept {
+            if (a.key != b.key) {
+                return a.key < b.key;
+            }
+            if (a.isValue != b.isValue) {
+                return b.isValue;
+            }
+            return a.index > b.index;
+        }
+
+        void push(Entry entry) {
+            heap.push_back(entry);
+            std::push_heap(heap.begin(), heap.end(), lower);
+        }
+
+        FrozenTrieMultimap const *trie;
+        Cursor start;
+        Bound bound;
+        std::size_t depthLimit;
+        std::vector<Entry> heap;
+    };
+
+    template <class Kss>
+    std::span<V const> find(Kss const &keys) const {
+        std::uint32_t current = 0;
+        for (K const &key : keys) {
+            current = child(current, key);
+            if (current == npos) {
+                return {};
+            }
+        }
+        return {values.data() + nodes[current].firstValue, nodes[current].numValues};
+    }
+
+    template <class Kss, class Visit>
+    bool visitPrefix(Kss const &keys, Visit &&visit, std::size_t depthLimit = (std::size_t)-1) const {
+        std::uint32_t current = 0;
+        for (K const &key : keys) {
+            current = child(current, key);
+            if (current == npos) {
+                return false;
+            }
+        }
+        Kss path = keys;
+        return visitItems(current, path, visit, depthLimit);
+    }
+
+    template <class Kss = std::vector<K>, class Visit>
+    bool visitItems(Visit &&visit, std::size_t depthLimit = (std::size_t)-1) const {
+        Kss path;
+        return visitItems(0, path, visit, depthLimit);
+    }
+
+private:
+    template <class Kss, class Visit>
+    bool visitItems(std::uint32_t node, Kss &path, Visit &&visit, std::size_t depthLimit) const {
+        if (depthLimit == 0) {
+            return false;
+        }
+        auto const &n = nodes[node];
+        for (std::uint32_t i = n.firstValue; i < n.firstValue + n.numValues; ++i) {
+            if (visit(std::as_const(path), values[i])) {
+                return true;
+            }
+        }
+        if (depthLimit <= 1) {
+            return false;
+        }
+        for (std::uint32_t c = n.firstChild; c < n.firstChild + n.numChildren; ++c) {
+            path.push_back(keys[c]);
+            bool stop = visitItems(c, path, visit, depthLimit - 1);
+            path.pop_back();
+            if (stop) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
 template <class K, class V, class Ks = std::vector<K>, class Vs = std::vector<V>, template <class, class> class KVPair = std::pair>
 struct TrieMultimap {
 private:
@@ -18,6 +326,44 @@ private:
     Node root;
 
 public:
+    // same as FrozenTrieMultimap::Cursor, valid until its node is erased
+    struct Cursor {
+        Node const *node = nullptr;
+        std::uint32_t depth = 0;
+
+        explicit operator bool() const noexcept {
+            return node != nullptr;
+        }
+    };
+
+    Cursor cursor() const noexcept {
+        return {&root, 0};
+    }
+
+    Cursor advance(Cursor cursor, K const &key) const {
+        if (!cursor) [[unlikely]] {
+            return cursor;
+        }
+        auto it = cursor.node->children.find(key);
+        if (it == cursor.node->children.end()) {
+            return {};
+        }
+        return {&*it->second, cursor.depth + 1};
+    }
+
+    Vs const &valuesAt(Cursor cursor) const {
+        static Vs const empty{};
+        return cursor ? cursor.node->values : empty;
+    }
+
+    template <class Kss, class Visit>
+    bool visitItems(Cursor cursor, Kss &path, Visit &&visit, std::size_t depthLimit = (std::size_t)-1) const {
+        if (!cursor) [[unlikely]] {
+            return false;
+        }
+        return visitItems(*cursor.node, path, visit, depthLimit);
+    }
+
     template <class Kss>
     void insert(Kss const &keys, V value) {
         Node *current = &root;
@@ -85,17 +431,24 @@ public:
             }
             current = &*it->second;
         }
-        return visitItems(*current, keys, visit, depthLimit);
+        Kss path = keys;
+        return visitItems(*current, path, visit, depthLimit);
     }
 
     template <class Kss = Ks, class Visit>
     bool visitItems(Visit &&visit, std::size_t depthLimit = (std::size_t)-1) const {
-        return visitItems(root, Kss(), visit, depthLimit);
+        Kss path;
+        return visitItems(root, path, visit, depthLimit);
+    }
+
+    FrozenTrieMultimap<K, V> freeze() const {
+        return FrozenTrieMultimap<K, V>(getItems());
     }
 
     std::vector<std::pair<Ks, V>> getItems() const {
         std::vector<std::pair<Ks, V>> values;
-        visitItems(root, Ks(), [&] (Ks const &keys, V const &value) {
+        Ks path;
+        visitItems(root, path, [&] (Ks const &keys, V const &value) {
             values.emplace_back(keys, value);
             return false;
         });
@@ -104,12 +457,12 @@ public:
 
 private:
     template <class Kss, class Visit>
-    static bool visitItems(Node const &node, Kss const &keys, Visit &&visit, std::size_t depthLimit = (std::size_t)-1) {
+    static bool visitItems(Node const &node, Kss &path, Visit &&visit, std::size_t depthLimit = (std::size_t)-1) {
         if (depthLimit == 0) {
             return false;
         }
         for (V const &v: node.values) {
-            if (visit(keys, v)) {
+            if (visit(std::as_const(path), v)) {
                 return true;
             }
         }
@@ -117,9 +470,10 @@ private:
             return false;
         }
         for (auto const &child : node.children) {
-            Kss newKeys = keys;
-            newKeys.push_back(child.first);
-            if (visitItems(*child.second, newKeys, visit, depthLimit - 1)) {
+            path.push_back(child.first);
+            bool stop = visitItems(*child.second, path, visit, depthLimit - 1);
+            path.pop_back();
+            if (stop) {
                 return true;
             }
         }
@@ -127,4 +481,68 @@ private:
     }
 };
 
+// a walk down a trie (anything with cursor(), advance() and visitItems() over cursors) that keeps the
+// cursor of every prefix of its path: extending by one key is a single child lookup, rewinding is free
+// and copies of a walk are independent, so per keystroke lookups only descend from the edited position
+template <class Trie, class K>
+struct TrieWalk {
+    using Cursor = typename Trie::Cursor;
+
+    explicit TrieWalk(Trie const &trie) : trie(&trie), cursors{trie.cursor()} {}
+
+    std::size_t depth() const noexcept {
+        return keys.size();
+    }
+
+    std::vector<K> const &path() const noexcept {
+        return keys;
+    }
+
+    Cursor const &cursor() const noexcept {
+        return cursors.back();
+    }
+
+    // whether the path is still in the trie
+    explicit operator bool() const noexcept {
+        return static_cast<bool>(cursors.back());
+    }
+
+    bool push(K const &key) {
+        cursors.push_back(trie->advance(cursors.back(), key));
+        keys.push_back(key);
+        return static_cast<bool>(cursors.back());
+    }
+
+    void pop() {
+        cursors.pop_back();
+        keys.pop_back();
+    }
+
+    void rewind(std::size_t depth) {
+        cursors.resize(std::min(depth, keys.size()) + 1);
+        keys.resize(cursors.size() - 1);
+    }
+
+    // move to path, keeping the cursors of the prefix it shares with the current path
+    template <class Kss>
+    bool walk(Kss const &path) {
+        auto common = std::mismatch(keys.begin(), keys.end(), path.begin(), path.end()).first - keys.begin();
+        rewind(common);
+        for (auto it = path.begin() + common; it != path.end(); ++it) {
+            push(*it);
+        }
+        return static_cast<bool>(*this);
+    }
+
+    template <class Visit>
+    bool visitItems(Visit &&visit, std::size_t depthLimit = (std::size_t)-1) {
+        return trie->visitItems(cursors.back(), keys, visit, depthLimit);
+    }
+
+private:
+    Trie const *trie;
+    std::vector<Cursor> cursors;
+    std::vector<K> keys;
+};
+
 }
@@ -1,8 +1,16 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <string_view>
-#include <cstdint>
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) && defined(__SSE2__)
+#include <immintrin.h>
+#define PINYINCPP_UTF_SIMD 1
+#else
+#define PINYINCPP_UTF_SIMD 0
+#endif
 
 namespace pinyincpp {
 
@@ -33,17 +41,197 @@ inline std::u8string utf32to8(char32_t c) {
     return result;
 }
 
-inline std::u32string utf8to32(std::u8string_view s) {
-    std::u32string result;
-    result.reserve(s.size());
+// the bulk conversions below copy runs of ascii with sse2 (avx2 where the cpu has it, checked at run time)
+// or eight bytes at a time elsewhere, and convert the rest char by char
+namespace utf_detail {
+
+inline std::size_t asciiPrefixScalar(unsigned char const *p, std::size_t n) noexcept {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, p + i, 8);
+        if (word & 0x8080808080808080ull) {
+            break;
+        }
+    }
+    while (i < n && p[i] < 0x80) {
+        ++i;
+    }
+    return i;
+}
+
+template <class Wide>
+inline std::size_t asciiPrefixScalar(Wide const *p, std::size_t n) noexcept {
+    std::size_t i = 0;
+    while (i < n && static_cast<std::uint32_t>(p[i]) < 0x80) {
+        ++i;
+    }
+    return i;
+}
+
+#if PINYINCPP_UTF_SIMD
+inline bool hasAvx2() noexcept {
+    static bool const avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+inline std::size_t asciiPrefixSse2(unsigned char const *p, std::size_t n) noexcept {
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        if (int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const *>(p + i)))) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + asciiPrefixScalar(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) inline std::size_t asciiPrefixAvx2(unsigned char const *p, std::size_t n) noexcept {
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        if (int mask = _mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(p + i)))) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + asciiPrefixSse2(p + i, n - i);
+}
+
+// code units below 0x80, four (char32_t) or eight (char16_t) per step
+template <class Wide>
+inline std::size_t asciiPrefixSse2(Wide const *p, std::size_t n) noexcept {
+    constexpr std::size_t kStep = 16 / sizeof(Wide);
+    __m128i high = sizeof(Wide) == 4 ? _mm_set1_epi32(~0x7F) : _mm_set1_epi16(static_cast<short>(0xFF80));
+    __m128i zero = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + kStep <= n; i += kStep) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<__m128i const *>(p + i)), high);
+        __m128i ascii = sizeof(Wide) == 4 ? _mm_cmpeq_epi32(v, zero) : _mm_cmpeq_epi16(v, zero);
+        int mask = _mm_movemask_epi8(ascii);
+        if (mask != 0xFFFF) {
+            return i + __builtin_ctz(~mask) / sizeof(Wide);
+        }
+    }
+    return i + asciiPrefixScalar(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) inline void widenAvx2(unsigned char const *p, char32_t *out, std::size_t n) noexcept {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(p + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), v);
+    }
+    for (; i < n; ++i) {
+        out[i] = p[i];
+    }
+}
+
+template <class Wide>
+inline void widenSse2(unsigned char const *p, Wide *out, std::size_t n) noexcept {
+    __m128i zero = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        auto *o = reinterpret_cast<__m128i *>(out + i);
+        if constexpr (sizeof(Wide) == 2) {
+            _mm_storeu_si128(o, lo);
+            _mm_storeu_si128(o + 1, hi);
+        } else {
+            _mm_storeu_si128(o, _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128(o + 1, _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128(o + 2, _mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_si128(o + 3, _mm_unpackhi_epi16(hi, zero));
+        }
+    }
+    for (; i < n; ++i) {
+        out[i] = p[i];
+    }
+}
+
+// code units known to be below 0x80, so the saturating packs keep them as is
+template <class Wide>
+inline void narrowSse2(Wide const *p, unsigned char *out, std::size_t n) noexcept {
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        auto const *v = reinterpret_cast<__m128i const *>(p + i);
+        __m128i bytes;
+        if constexpr (sizeof(Wide) == 2) {
+            bytes = _mm_packus_epi16(_mm_loadu_si128(v), _mm_loadu_si128(v + 1));
+        } else {
+            __m128i lo = _mm_packs_epi32(_mm_loadu_si128(v), _mm_loadu_si128(v + 1));
+            __m128i hi = _mm_packs_epi32(_mm_loadu_si128(v + 2), _mm_loadu_si128(v + 3));
+            bytes = _mm_packus_epi16(lo, hi);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), bytes);
+    }
+    for (; i < n; ++i) {
+        out[i] = static_cast<unsigned char>(p[i]);
+    }
+}
+#endif
+
+inline std::size_t asciiPrefix(unsigned char const *p, std::size_t n) noexcept {
+#if PINYINCPP_UTF_SIMD
+    return hasAvx2() ? asciiPrefixAvx2(p, n) : asciiPrefixSse2(p, n);
+#else
+    return asciiPrefixScalar(p, n);
+#endif
+}
+
+template <class Wide>
+inline std::size_t asciiPrefix(Wide const *p, std::size_t n) noexcept {
+#if PINYINCPP_UTF_SIMD
+    return asciiPrefixSse2(p, n);
+#else
+    return asciiPrefixScalar(p, n);
+#endif
+}
+
+// appends n ascii bytes to out as code units
+template <class Wide>
+inline void appendWidened(unsigned char const *p, std::size_t n, std::basic_string<Wide> &out) {
+    std::size_t old = out.size();
+    out.resize(old + n);
+#if PINYINCPP_UTF_SIMD
+    if constexpr (sizeof(Wide) == 4) {
+        if (hasAvx2()) {
+            widenAvx2(p, reinterpret_cast<char32_t *>(out.data() + old), n);
+            return;
+        }
+    }
+    widenSse2(p, out.data() + old, n);
+#else
+    std::copy(p, p + n, out.data() + old);
+#endif
+}
+
+// appends n code units below 0x80 to out as bytes
+template <class Wide, class Byte>
+inline void appendNarrowed(Wide const *p, std::size_t n, std::basic_string<Byte> &out) {
+    std::size_t old = out.size();
+    out.resize(old + n);
+#if PINYINCPP_UTF_SIMD
+    narrowSse2(p, reinterpret_cast<unsigned char *>(out.data() + old), n);
+#else
+    std::transform(p, p + n, out.data() + old, [] (Wide c) { return static_cast<Byte>(c); });
+#endif
+}
+
+// utf-8 to utf-32 or utf-16, invalid lead bytes are skipped
+template <class Wide>
+inline void decodeUtf8(unsigned char const *p, std::size_t n, std::basic_string<Wide> &out) {
     std::uint32_t state = 0;
     std::uint32_t codepoint = 0;
-    for (auto c : s) {
-        std::uint8_t byte = (std::uint8_t)c;
+    for (std::size_t i = 0; i < n;) {
         if (state == 0) {
-            if (byte < 0x80) {
-                result.push_back(codepoint = byte);
-            } else if (0xC0 <= byte && byte < 0xE0) {
+            if (std::size_t run = asciiPrefix(p + i, n - i)) {
+                appendWidened(p + i, run, out);
+                if ((i += run) == n) {
+                    break;
+                }
+            }
+            std::uint8_t byte = p[i++];
+            if (0xC0 <= byte && byte < 0xE0) {
                 codepoint = byte & 0x1F;
                 state = 1;
             } else if (0xE0 <= byte && byte < 0xF0) {
@@ -54,107 +242,168 @@ inline std::u32string utf8to32(std::u8string_view s) {
                 state = 3;
             }
         } else {
-            codepoint = (codepoint << 6) | (byte & 0x3F);
+            codepoint = (codepoint << 6) | (p[i++] & 0x3F);
             state -= 1;
             if (state == 0) {
-                result.push_back(codepoint);
+                if (sizeof(Wide) == 2 && codepoint >= 0x10000) {
+                    codepoint -= 0x10000;
+                    out.push_back(static_cast<Wide>(0xD800 | ((codepoint >> 10) & 0x3FF)));
+                    out.push_back(static_cast<Wide>(0xDC00 | (codepoint & 0x3FF)));
+                } else {
+                    out.push_back(static_cast<Wide>(codepoint));
+                }
             }
         }
     }
-    return result;
 }
 
-inline std::u8string utf32to8(std::u32string_view s) {
-    std::u8string result;
-    result.reserve(s.size());
-    for (char32_t c : s) {
-        if (c < 0x80) {
-            result.push_back(c);
-        } else if (c < 0x800) {
-            result.push_back((char8_t)(0xC0 | (c >> 6)));
-            result.push_back((char8_t)(0x80 | (c & 0x3F)));
-        } else if (c < 0x10000) {
-            result.push_back((char8_t)(0xE0 | (c >> 12)));
-            result.push_back((char8_t)(0x80 | ((c >> 6) & 0x3F)));
-            result.push_back((char8_t)(0x80 | (c & 0x3F)));
-        } else if (c < 0x200000) {
-            result.push_back((char8_t)(0xF0 | (c >> 18)));
-            result.push_back((char8_t)(0x80 | ((c >> 12) & 0x3F)));
-            result.push_back((char8_t)(0x80 | ((c >> 6) & 0x3F)));
-            result.push_back((char8_t)(0x80 | (c & 0x3F)));
+template <class Byte>
+inline void appendUtf8(std::uint32_t c, std::basic_string<Byte> &out) {
+    if (c < 0x80) {
+        out.push_back(static_cast<Byte>(c));
+    } else if (c < 0x800) {
+        out.push_back(static_cast<Byte>(0xC0 | (c >> 6)));
+        out.push_back(static_cast<Byte>(0x80 | (c & 0x3F)));
+    } else if (c < 0x10000) {
+        out.push_back(static_cast<Byte>(0xE0 | (c >> 12)));
+        out.push_back(static_cast<Byte>(0x80 | ((c >> 6) & 0x3F)));
+        out.push_back(static_cast<Byte>(0x80 | (c & 0x3F)));
+    } else if (c < 0x200000) {
+        out.push_back(static_cast<Byte>(0xF0 | (c >> 18)));
+        out.push_back(static_cast<Byte>(0x80 | ((c >> 12) & 0x3F)));
+        out.push_back(static_cast<Byte>(0x80 | ((c >> 6) & 0x3F)));
+        out.push_back(static_cast<Byte>(0x80 | (c & 0x3F)));
+    }
+}
+
+// utf-32 to utf-8, code points from 0x200000 up are dropped
+template <class Byte>
+inline void encodeUtf8(char32_t const *p, std::size_t n, std::basic_string<Byte> &out) {
+    out.reserve(out.size() + n);
+    for (std::size_t i = 0; i < n;) {
+        if (std::size_t run = asciiPrefix(p + i, n - i)) {
+            appendNarrowed(p + i, run, out);
+            if ((i += run) == n) {
+                break;
+            }
         }
+        appendUtf8(p[i++], out);
     }
-    return result;
 }
 
-inline std::u8string utf16to8(std::u16string_view s) {
-    std::u8string result;
-    result.reserve(s.size());
-    int phase = 0;
-    char16_t surrogate;
-    for (char16_t c : s) {
-        if (c < 0x80) {
-            result.push_back((char8_t)c);
-        } else if (c < 0x800) {
-            result.push_back((char8_t)(0xC0 | (c >> 6)));
-            result.push_back((char8_t)(0x80 | (c & 0x3F)));
-        } else if (c < 0xD800 || c > 0xDFFF) {
-            result.push_back((char8_t)(0xE0 | (c >> 12)));
-            result.push_back((char8_t)(0x80 | ((c >> 6) & 0x3F)));
-            result.push_back((char8_t)(0x80 | (c & 0x3F)));
-        } else {
-            if (phase == 0) {
-                phase = 1;
-                surrogate = c;
-            } else {
-                phase = 0;
-                std::uint32_t codepoint = 0x10000 + (((std::uint32_t)surrogate - 0xD800) << 10) | (((std::uint32_t)c - 0xDC00) & 0x3FF);
-                result.push_back((char8_t)(0xF0 | (codepoint >> 18)));
-                result.push_back((char8_t)(0x80 | ((codepoint >> 12) & 0x3F)));
-                result.push_back((char8_t)(0x80 | ((codepoint >> 6) & 0x3F)));
-                result.push_back((char8_t)(0x80 | (codepoint & 0x3F)));
+// utf-16 to utf-8, any surrogate following a surrogate makes a pair with it
+template <class Byte>
+inline void encodeUtf8(char16_t const *p, std::size_t n, std::basic_string<Byte> &out) {
+    out.reserve(out.size() + n);
+    bool paired = false;
+    char16_t surrogate = 0;
+    for (std::size_t i = 0; i < n;) {
+        if (std::size_t run = asciiPrefix(p + i, n - i)) {
+            appendNarrowed(p + i, run, out);
+            if ((i += run) == n) {
+                break;
             }
         }
+        char16_t c = p[i++];
+        if (c < 0xD800 || c > 0xDFFF) {
+            appendUtf8(c, out);
+        } else if (!paired) {
+            paired = true;
+            surrogate = c;
+        } else {
+            paired = false;
+            // always four bytes, even for a pair of two low surrogates
+            std::uint32_t codepoint = 0x10000 + (((std::uint32_t)surrogate - 0xD800) << 10) + (((std::uint32_t)c - 0xDC00) & 0x3FF);
+            out.push_back(static_cast<Byte>(0xF0 | (codepoint >> 18)));
+            out.push_back(static_cast<Byte>(0x80 | ((codepoint >> 12) & 0x3F)));
+            out.push_back(static_cast<Byte>(0x80 | ((codepoint >> 6) & 0x3F)));
+            out.push_back(static_cast<Byte>(0x80 | (codepoint & 0x3F)));
+        }
     }
-    return result;
 }
 
-inline std::u16string utf8to16(std::u8string_view s) {
-    std::u16string result;
-    result.reserve(s.size());
-    std::uint32_t state = 0;
-    std::uint32_t codepoint = 0;
-    for (auto c : s) {
-        std::uint8_t byte = (std::uint8_t)c;
+inline bool validateUtf8(unsigned char const *p, std::size_t n) noexcept {
+    int state = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        std::uint8_t c = p[i];
         if (state == 0) {
-            if (byte < 0x80) {
-                result.push_back(byte);
-            } else if (0xC0 <= byte && byte < 0xE0) {
-                codepoint = byte & 0x1F;
+            if ((c & 0x80) == 0) {
+                i += asciiPrefix(p + i, n - i) - 1;
+            } else if ((c & 0xE0) == 0xC0) {
                 state = 1;
-            } else if (0xE0 <= byte && byte < 0xF0) {
-                codepoint = byte & 0x0F;
+            } else if ((c & 0xF0) == 0xE0) {
                 state = 2;
-            } else if (0xF0 <= byte && byte < 0xF8) {
-                codepoint = byte & 0x07;
+            } else if ((c & 0xF8) == 0xF0) {
                 state = 3;
+            } else if ((c & 0xFC) == 0xF8) {
+                state = 4;
+            } else if ((c & 0xFE) == 0xFC) {
+                state = 5;
+            } else {
+                return false;
             }
         } else {
-            codepoint = (codepoint << 6) | (byte & 0x3F);
-            state -= 1;
-            if (state == 0) {
-                if (codepoint >= 0x10000) {
-                    codepoint -= 0x10000;
-                    char16_t high = (char16_t)(0xD800 | ((codepoint >> 10) & 0x3FF));
-                    char16_t low = (char16_t)(0xDC00 | (codepoint & 0x3FF));
-                    result.push_back(high);
-                    result.push_back(low);
-                } else {
-                    result.push_back((char16_t)codepoint);
-                }
+            if ((c & 0xC0) == 0x80) {
+                state--;
+            } else {
+                return false;
             }
         }
     }
+    return state == 0;
+}
+
+inline unsigned char const *bytes(std::u8string_view s) noexcept {
+    return reinterpret_cast<unsigned char const *>(s.data());
+}
+
+inline unsigned char const *bytes(std::string_view s) noexcept {
+    return reinterpret_cast<unsigned char const *>(s.data());
+}
+
+}
+
+// the overloads taking an out string append to it, so a buffer can be reused across calls
+
+inline void utf8to32(std::u8string_view s, std::u32string &out) {
+    out.reserve(out.size() + s.size());
+    utf_detail::decodeUtf8(utf_detail::bytes(s), s.size(), out);
+}
+
+inline std::u32string utf8to32(std::u8string_view s) {
+    std::u32string result;
+    utf8to32(s, result);
+    return result;
+}
+
+inline void utf32to8(std::u32string_view s, std::u8string &out) {
+    utf_detail::encodeUtf8(s.data(), s.size(), out);
+}
+
+inline std::u8string utf32to8(std::u32string_view s) {
+    std::u8string result;
+    utf32to8(s, result);
+    return result;
+}
+
+inline void utf16to8(std::u16string_view s, std::u8string &out) {
+    utf_detail::encodeUtf8(s.data(), s.size(), out);
+}
+
+inline std::u8string utf16to8(std::u16string_view s) {
+    std::u8string result;
+    utf16to8(s, result);
+    return result;
+}
+
+inline void utf8to16(std::u8string_view s, std::u16string &out) {
+    out.reserve(out.size() + s.size());
+    utf_detail::decodeUtf8(utf_detail::bytes(s), s.size(), out);
+}
+
+inline std::u16string utf8to16(std::u8string_view s) {
+    std::u16string result;
+    utf8to16(s, result);
     return result;
 }
 
@@ -205,24 +454,60 @@ inline std::string utf8toC(std::u8string_view s) {
     return std::string((const char *)s.data(), s.size());
 }
 
+inline void utfCto32(std::string_view s, std::u32string &out) {
+    out.reserve(out.size() + s.size());
+    utf_detail::decodeUtf8(utf_detail::bytes(s), s.size(), out);
+}
+
 inline std::u32string utfCto32(std::string_view s) {
-    return utf8to32(utfCto8(s));
+    std::u32string result;
+    utfCto32(s, result);
+    return result;
+}
+
+inline void utf8to16(std::string_view s, std::u16string &out) {
+    out.reserve(out.size() + s.size());
+    utf_detail::decodeUtf8(utf_detail::bytes(s), s.size(), out);
 }
 
 inline std::u16string utf8to16(std::string_view s) {
-    return utf8to16(utfCto8(s));
+    std::u16string result;
+    utf8to16(s, result);
+    return result;
+}
+
+inline void utf32toC(char32_t c, std::string &out) {
+    if (c < 0x200000) {
+        utf_detail::appendUtf8(c, out);
+    } else {
+        out.push_back('?');
+    }
 }
 
 inline std::string utf32toC(char32_t c) {
-    return utf8toC(utf32to8(c));
+    std::string result;
+    utf32toC(c, result);
+    return result;
+}
+
+inline void utf32toC(std::u32string_view s, std::string &out) {
+    utf_detail::encodeUtf8(s.data(), s.size(), out);
 }
 
 inline std::string utf32toC(std::u32string_view s) {
-    return utf8toC(utf32to8(s));
+    std::string result;
+    utf32toC(s, result);
+    return result;
+}
+
+inline void utf16toC(std::u16string_view s, std::string &out) {
+    utf_detail::encodeUtf8(s.data(), s.size(), out);
 }
 
 inline std::string utf16toC(std::u16string_view s) {
-    return utf8toC(utf16to8(s));
+    std::string result;
+    utf16toC(s, result);
+    return result;
 }
 
 inline std::wstring utf8toW(std::u8string_view s) {
@@ -298,33 +583,7 @@ inline std::string utfWtoC(std::wstring_view s) {
 }
 
 inline bool utf8Validate(std::u8string_view s) {
-    int state = 0;
-    for (char8_t c : s) {
-        if (state == 0) {
-            if ((c & 0x80) == 0) {
-                state = 0;
-            } else if ((c & 0xE0) == 0xC0) {
-                state = 1;
-            } else if ((c & 0xF0) == 0xE0) {
-                state = 2;
-            } else if ((c & 0xF8) == 0xF0) {
-                state = 3;
-            } else if ((c & 0xFC) == 0xF8) {
-                state = 4;
-            } else if ((c & 0xFE) == 0xFC) {
-                state = 5;
-            } else {
-                return false;
-            }
-        } else {
-            if ((c & 0xC0) == 0x80) {
-                state--;
-            } else {
-                return false;
-            }
-        }
-    }
-    return state == 0;
+    return utf_detail::validateUtf8(utf_detail::bytes(s), s.size());
 }
 
 inline bool utf16Validate(std::u16string_view s) {
@@ -366,7 +625,7 @@ inline bool utfWValidate(std::wstring_view s) {
 }
 
 inline bool utfCValidate(std::string_view s) {
-    return utf8Validate(std::u8string_view((const char8_t *)s.data(), s.size()));
+    return utf_detail::validateUtf8(utf_detail::bytes(s), s.size());
 }
 
 }
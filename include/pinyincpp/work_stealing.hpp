@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace pinyincpp {
+
+// run work(worker, chunk, begin, end) over [0, numItems) split into chunks of chunkSize,
+// each worker drains its own deque from the back and steals from the front of others when idle,
+// the calling thread is worker 0, numThreads == 0 means hardware concurrency
+template <class Work>
+void workStealingFor(std::size_t numItems, std::size_t chunkSize, std::size_t numThreads, Work &&work) {
+    if (!numItems) [[unlikely]] {
+        return;
+    }
+    chunkSize = std::max<std::size_t>(chunkSize, 1);
+    std::size_t numChunks = (numItems + chunkSize - 1) / chunkSize;
+    if (!numThreads) {
+        numThreads = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    numThreads = std::min(numThreads, numChunks);
+    auto runChunk = [&] (std::size_t worker, std::size_t chunk) {
+        work(worker, chunk, chunk * chunkSize, std::min(numItems, (chunk + 1) * chunkSize));
+    };
+    if (numThreads == 1) {
+        for (std::size_t chunk = 0; chunk < numChunks; ++chunk) {
+            runChunk(0, chunk);
+        }
+        return;
+    }
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::size_t> chunks;
+    };
+    std::vector<Queue> queues(numThreads);
+    // contiguous runs of chunks per worker, popped from the back so steals take the far end
+    for (std::size_t t = 0; t < numThreads; ++t) {
+        for (std::size_t chunk = numChunks * (t + 1) / numThreads; chunk-- > numChunks * t / numThreads;) {
+            queues[t].chunks.push_back(chunk);
+        }
+    }
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    auto worker = [&] (std::size_t t) {
+        auto pop = [&] (std::size_t q, bool own) -> std::size_t {
+            std::lock_guard lock(queues[q].mutex);
+            auto &chunks = queues[q].chunks;
+            if (chunks.empty()) {
+                return (std::size_t)-1;
+            }
+            std::size_t chunk;
+            if (own) {
+                chunk = chunks.back();
+                chunks.pop_back();
+            } else {
+                chunk = chunks.front();
+                chunks.pop_front();
+            }
+            return chunk;
+        };
+        try {
+            while (true) {
+                std::size_t chunk = pop(t, true);
+                for (std::size_t i = 1; chunk == (std::size_t)-1 && i < numThreads; ++i) {
+                    chunk = pop((t + i) % numThreads, false);
+                }
+                if (chunk == (std::size_t)-1) {
+                    break;
+                }
+                runChunk(t, chunk);
+            }
+        } catch (...) {
+            std::lock_guard lock(errorMutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+    for (std::size_t t = 1; t < numThreads; ++t) {
+        threads.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+}
@@ -0,0 +1,52 @@
+# prints the gb18030 tables pasted into include/pinyincpp/gbk.hpp:
+# two-byte codes gbk leaves undefined as runs of (gbk.bin index, code point, length),
+# and four-byte codes below U+10000 as ranges of (linear index, code point) counting up together
+
+def linear(b):
+    return (((b[0] - 0x81) * 10 + (b[1] - 0x30)) * 126 + (b[2] - 0x81)) * 10 + (b[3] - 0x30)
+
+def dump(items):
+    line = '       '
+    for item in items:
+        if len(line) + len(item) > 116:
+            print(line)
+            line = '       '
+        line += ' ' + item
+    print(line)
+
+extras = []
+for hi in range(0x81, 0xfe + 1):
+    for lo in range(0x40, 0xfe + 1):
+        n = bytes([hi, lo])
+        try:
+            n.decode('gbk')
+            continue
+        except UnicodeDecodeError:
+            pass
+        try:
+            c = ord(n.decode('gb18030'))
+        except UnicodeDecodeError:
+            continue
+        index = (hi - 0x81) * 191 + (lo - 0x40)
+        if extras and index == extras[-1][0] + extras[-1][2] and c == extras[-1][1] + extras[-1][2]:
+            extras[-1][2] += 1
+        else:
+            extras.append([index, c, 1])
+
+ranges = []
+last = None
+for c in range(0x80, 0x10000):
+    if 0xd800 <= c <= 0xdfff:
+        continue
+    n = chr(c).encode('gb18030')
+    if len(n) != 4:
+        continue
+    p = linear(n)
+    if last is None or p - last[0] != c - last[1]:
+        ranges.append((p, c))
+    last = (p, c)
+
+print('kTwoByteExtras')
+dump(['{%d, 0x%04X, %d},' % tuple(e) for e in extras])
+print('kRanges')
+dump(['{%d, 0x%04X},' % r for r in ranges])
@@ -1,4 +1,5 @@
 import math
+import zlib
 from pinyintools import untone_pinyin
 
 tabPin = {}
@@ -72,39 +73,47 @@ print(len(tabPinyin))
 print(len(tab))
 print(len(tabWord))
 
+wordsData = bytearray(len(tabWord).to_bytes(4, 'little'))
+for pinyins, words in tabWord.items():
+    data = len(pinyins).to_bytes(1, 'little')
+    for pinyin in pinyins:
+        tone = 0
+        if pinyin[-1].isdigit():
+            tone = int(pinyin[-1])
+            pinyin = pinyin[:-1]
+        pid = tabPids[pinyin] * 8 + tone
+        data += pid.to_bytes(2, 'little')
+    assert len(words)
+    for word in words:
+        word16 = word.encode('utf-16')[2:]
+        assert len(word16)
+        logProb = 1
+        for w in word:
+            w = ord(w)
+            if w not in tab:
+                print(chr(w))
+                count = 0
+            else:
+                count = tab[w][0]
+            logProb += math.log(count + 1.1)
+        logProb /= len(word)
+        logProbQuant = int(logProb * 2048)
+        if logProbQuant >= 65536:
+            print(logProb)
+        data += (len(word16) // 2).to_bytes(1, 'little')
+        data += logProbQuant.to_bytes(2, 'little')
+        data += word16
+    data += b'\x00'
+    wordsData += data
+
+# PinyinWordsDB::WordsHeader, checked when the words are loaded from a file at run time
 with open('data/pinyin-words.bin', 'wb') as f:
-    f.write(len(tabWord).to_bytes(4, 'little'))
-    for pinyins, words in tabWord.items():
-        data = len(pinyins).to_bytes(1, 'little')
-        for pinyin in pinyins:
-            tone = 0
-            if pinyin[-1].isdigit():
-                tone = int(pinyin[-1])
-                pinyin = pinyin[:-1]
-            pid = tabPids[pinyin] * 8 + tone
-            data += pid.to_bytes(2, 'little')
-        assert len(words)
-        for word in words:
-            word16 = word.encode('utf-16')[2:]
-            assert len(word16)
-            logProb = 1
-            for w in word:
-                w = ord(w)
-                if w not in tab:
-                    print(chr(w))
-                    count = 0
-                else:
-                    count = tab[w][0]
-                logProb += math.log(count + 1.1)
-            logProb /= len(word)
-            logProbQuant = int(logProb * 2048)
-            if logProbQuant >= 65536:
-                print(logProb)
-            data += (len(word16) // 2).to_bytes(1, 'little')
-            data += logProbQuant.to_bytes(2, 'little')
-            data += word16
-        data += b'\x00'
-        f.write(data)
+    f.write(b'PYCPPWD\x00')
+    f.write((1).to_bytes(4, 'little'))
+    f.write(len(wordsData).to_bytes(4, 'little'))
+    f.write(zlib.crc32(wordsData).to_bytes(4, 'little'))
+    f.write((0).to_bytes(4, 'little'))
+    f.write(wordsData)
 
 with open('data/pinyin.bin', 'wb') as f:
     f.write(len(tabPinyin).to_bytes(4, 'little'))
@@ -0,0 +1,27 @@
+#include <pinyincpp/pinyin_decoder.hpp>
+#include <pinyincpp/pinyin_lattice.hpp>
+#include <chrono>
+#include <iostream>
+
+using namespace pinyincpp;
+
+int main() {
+    PinyinDB db;
+    PinyinWordsDB wd;
+    PinyinDecoder decoder;
+    for (std::u32string input : {U"xian", U"fangan", U"woshixiaopengyou", U"zhongguorendelaoshi"}) {
+        std::cout << utf32toC(input) << ":\n";
+        PinyinLattice lattice(db, &wd, input);
+        for (auto const &path : lattice.kBest(3)) {
+            std::cout << "  " << db.pinyinConcat(path.pids) << " (" << path.score << ")\n";
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        auto sentences = decoder.decode(db, wd, lattice.bestPath().pids, 3);
+        auto t1 = std::chrono::steady_clock::now();
+        for (auto const &s : sentences) {
+            std::cout << "  " << utf32toC(s.text) << " (" << s.score << ")\n";
+        }
+        std::cout << "  decoded in " << std::chrono::duration<double, std::micro>(t1 - t0).count() << "us\n";
+    }
+    return 0;
+}
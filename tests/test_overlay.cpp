@@ -0,0 +1,49 @@
+#include <pinyincpp/pinyin_server.hpp>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace pinyincpp;
+
+int main() {
+    PinyinServer ps;
+    ps.onLoadSample("我是可爱的小彭友，老师好", 1.0);
+    // each user defines a different word for the same pinyin, no user sees another's
+    std::vector<std::string> users = {"老狮", "老湿", "捞师", "劳施"};
+    std::vector<std::string> firsts(users.size());
+    std::vector<std::shared_ptr<PinyinOverlay>> overlays;
+    for (std::size_t u = 0; u < users.size(); ++u) {
+        overlays.push_back(ps.newOverlay());
+    }
+    std::vector<std::jthread> threads;
+    for (std::size_t u = 0; u < users.size(); ++u) {
+        threads.emplace_back([&, u] {
+            auto overlay = overlays[u];
+            overlay->defineWords({{"lao shi", users[u]}}, 2.0);
+            auto session = ps.session(overlay);
+            for (int i = 0; i < 200; ++i) {
+                auto res = session.onInput("我是", i % 2 ? "laoshi" : "laosh", 5);
+                if (i == 199 && !res.candidates.empty()) {
+                    firsts[u] = res.candidates.front().text;
+                }
+                if (i % 50 == 0) {
+                    overlay->addSampleString("我是" + users[u], 0.5);
+                }
+            }
+        });
+    }
+    // the shared overlay changes meanwhile, sessions of users only see their own
+    ps.onDefineWords("lao shi=老师\n");
+    for (int i = 0; i < 20; ++i) {
+        ps.onLoadSample("老师好", 0.1);
+    }
+    threads.clear();
+    for (std::size_t u = 0; u < users.size(); ++u) {
+        std::cout << users[u] << ": " << firsts[u] << '\n';
+    }
+    for (auto c: ps.onInput("我是", "laoshi", 5).candidates) {
+        std::cout << '[' << c.text << '|' << c.enggy << ']' << c.eatBytes << ' ' << c.score << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <pinyincpp/pinyin_server.hpp>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace pinyincpp;
+
+int main() {
+    PinyinDB::fromResource().saveSnapshot("/tmp/pinyin.snap");
+    {
+        // the embedded words may predate the header, wrap them as an update file would be
+        std::string_view words = CMakeResource("data/pinyin-words.bin").view();
+        if (words.substr(0, sizeof(PinyinWordsDB::kWordsMagic)) == std::string_view(PinyinWordsDB::kWordsMagic, sizeof(PinyinWordsDB::kWordsMagic))) {
+            words.remove_prefix(sizeof(PinyinWordsDB::WordsHeader));
+        }
+        PinyinWordsDB::WordsHeader header{};
+        std::memcpy(header.magic, PinyinWordsDB::kWordsMagic, sizeof(header.magic));
+        header.version = PinyinWordsDB::kWordsVersion;
+        header.size = words.size();
+        header.checksum = crc32(words);
+        std::ofstream fout("/tmp/pinyin-words.bin", std::ios::binary);
+        fout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        fout.write(words.data(), words.size());
+    }
+    {
+        std::ifstream fin("/tmp/pinyin.snap", std::ios::binary);
+        std::string image(std::istreambuf_iterator<char>{fin}, std::istreambuf_iterator<char>{});
+        image[image.size() / 2] ^= 1;
+        try {
+            PinyinDB::loadSnapshot(image);
+            std::cout << "corrupt snapshot loaded\n";
+        } catch (std::runtime_error const &e) {
+            std::cout << e.what() << '\n';
+        }
+    }
+
+    PinyinServer ps;
+    ps.onDefineWords("lao shi=老师\n");
+    std::atomic<bool> stop{false};
+    std::atomic<std::size_t> numInputs{0};
+    std::vector<std::jthread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&] {
+            auto session = ps.session();
+            while (!stop.load(std::memory_order_relaxed)) {
+                session.onInput("我是", "laoshi", 10);
+                numInputs.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (int i = 0; i < 20; ++i) {
+        ps.loadDictionary("/tmp/pinyin.snap", "/tmp/pinyin-words.bin");
+    }
+    stop = true;
+    readers.clear();
+    std::cout << numInputs.load() << " inputs during 20 swaps\n";
+    auto res = ps.onInput("我是", "laoshi", 5);
+    for (auto c: res.candidates) {
+        std::cout << '[' << c.text << '|' << c.enggy << ']' << c.eatBytes << ' ' << c.score << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+#include <pinyincpp/pinyin_chars.hpp>
+#include <iostream>
+
+using namespace pinyincpp;
+
+int main() {
+    PinyinDB::fromResource().saveSnapshot("/tmp/pinyin.snap");
+    auto db = PinyinDB::openSnapshot("/tmp/pinyin.snap");
+    std::cout << db.pinyinConcat(db.pinyinSplit(U"woshixiaopengyou")) << '\n';
+    for (auto const &c : db.pinyinToChar(db.pinyinId("xiao"))) {
+        std::cout << utf32toC(c.character) << ' ' << c.logFrequency << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,22 @@
+#include <pinyincpp/pinyin_transliterator.hpp>
+#include <iostream>
+
+using namespace pinyincpp;
+
+int main() {
+    PinyinDB db;
+    PinyinTransliterator tr(db, {PinyinTransliterator::ToneStyle::kMark, " "});
+    std::cout << tr.transliterate("我爱北京天安门, hello!") << std::endl;
+    std::string text = "中华人民共和国";
+    std::string out;
+    for (std::size_t i = 0; i < text.size(); i += 2) {
+        tr.feed(std::string_view(text).substr(i, 2), out);
+    }
+    tr.finish(out);
+    std::cout << out << std::endl;
+    auto batch = tr.transliterateBatch(std::vector<std::string>{"拼音", "汉字"});
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        std::cout << batch[i] << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,213 @@
+#include <pinyincpp/mapped_file.hpp>
+#include <pinyincpp/pinyin_transliterator.hpp>
+#include <algorithm>
+#include <memory>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace pinyincpp;
+
+namespace {
+
+constexpr std::size_t kBlockSize = 1 << 20;
+constexpr std::size_t kBlocksPerThread = 4; // converted blocks allowed to wait for the writer
+
+struct Block {
+    std::string_view input;
+    std::string output;
+    std::size_t numLines = 0;
+    bool done = false;
+};
+
+// blocks of about kBlockSize bytes, each ending after a newline (or at the end of text)
+std::vector<Block> splitBlocks(std::string_view text) {
+    std::vector<Block> blocks;
+    std::size_t begin = 0;
+    while (begin < text.size()) {
+        std::size_t end = std::min(begin + kBlockSize, text.size());
+        if (end < text.size()) {
+            auto newline = text.find('\n', end - 1);
+            end = newline == std::string_view::npos ? text.size() : newline + 1;
+        }
+        blocks.push_back({.input = text.substr(begin, end - begin), .output = {}, .numLines = 0, .done = false});
+        begin = end;
+    }
+    return blocks;
+}
+
+// line endings are kept as is, a line is converted without its \r\n or \n
+void convertBlock(PinyinTransliterator &tr, Block &block) {
+    auto input = block.input;
+    block.output.reserve(input.size() * 2);
+    while (!input.empty()) {
+        auto newline = input.find('\n');
+        auto lineEnd = newline == std::string_view::npos ? input.size() : newline + 1;
+        auto line = input.substr(0, lineEnd);
+        auto textEnd = line.size();
+        if (textEnd && line[textEnd - 1] == '\n') {
+            --textEnd;
+            if (textEnd && line[textEnd - 1] == '\r') {
+                --textEnd;
+            }
+        }
+        tr.feed(line.substr(0, textEnd), block.output);
+        tr.finish(block.output);
+        block.output.append(line.substr(textEnd));
+        ++block.numLines;
+        input.remove_prefix(lineEnd);
+    }
+}
+
+int usage(const char *argv0) {
+    std::cerr << "usage: " << argv0 << " [-c] [-j threads] [-t none|number|mark] [-s separator] [-d snapshot] input [output]\n"
+              << "  -c  read polyphones from word context instead of taking the first reading of each char\n";
+    return 2;
+}
+
+}
+
+int main(int argc, char **argv) {
+    std::size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+    PinyinTransliterator::Options options;
+    std::string snapshotPath, inputPath, outputPath;
+    bool context = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "-c") {
+            context = true;
+        } else if (arg.size() == 2 && arg[0] == '-' && i + 1 < argc) {
+            std::string value = argv[++i];
+            if (arg == "-j") {
+                try {
+                    numThreads = std::max<std::size_t>(1, std::stoul(value));
+                } catch (std::logic_error const &) {
+                    return usage(argv[0]);
+                }
+            } else if (arg == "-t") {
+                if (value == "none") {
+                    options.tone = PinyinTransliterator::ToneStyle::kNone;
+                } else if (value == "number") {
+                    options.tone = PinyinTransliterator::ToneStyle::kNumber;
+                } else if (value == "mark") {
+                    options.tone = PinyinTransliterator::ToneStyle::kMark;
+                } else {
+                    return usage(argv[0]);
+                }
+            } else if (arg == "-s") {
+                options.separator = value;
+            } else if (arg == "-d") {
+                snapshotPath = value;
+            } else {
+                return usage(argv[0]);
+            }
+        } else if (inputPath.empty()) {
+            inputPath = arg;
+        } else if (outputPath.empty()) {
+            outputPath = arg;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (inputPath.empty()) {
+        return usage(argv[0]);
+    }
+
+    std::optional<PinyinDB> dbStorage;
+    std::unique_ptr<PinyinWordsDB> wd;
+    std::unique_ptr<PinyinPolyphone> polyphone;
+    try {
+        dbStorage.emplace(snapshotPath.empty() ? PinyinDB::fromResource() : PinyinDB::openSnapshot(snapshotPath));
+        if (context) {
+            wd = std::make_unique<PinyinWordsDB>();
+            polyphone = std::make_unique<PinyinPolyphone>(*dbStorage, *wd);
+            options.context = polyphone.get();
+        }
+    } catch (std::exception const &e) {
+        std::cerr << "cannot open dictionary: " << (snapshotPath.empty() ? "embedded" : snapshotPath) << " (" << e.what() << ")\n";
+        return 1;
+    }
+    auto &db = *dbStorage;
+    MappedFile file;
+    try {
+        file = MappedFile(inputPath);
+    } catch (std::runtime_error const &e) {
+        std::cerr << "cannot open input file: " << inputPath << " (" << e.what() << ")\n";
+        return 1;
+    }
+    std::ofstream fout;
+    if (!outputPath.empty()) {
+        fout.open(outputPath, std::ios::binary);
+        if (!fout) {
+            std::cerr << "cannot open output file: " << outputPath << '\n';
+            return 1;
+        }
+    }
+    std::ostream &out = outputPath.empty() ? std::cout : fout;
+
+    auto t0 = std::chrono::steady_clock::now();
+    auto blocks = splitBlocks(file.view());
+    numThreads = std::min(numThreads, std::max<std::size_t>(1, blocks.size()));
+    std::size_t window = numThreads * kBlocksPerThread;
+    std::mutex mutex;
+    std::condition_variable blockDone, blockWritten;
+    std::size_t nextBlock = 0, numWritten = 0;
+
+    // each worker owns its transliterator, the dbs are only read
+    std::vector<std::jthread> workers;
+    for (std::size_t t = 0; t < numThreads; ++t) {
+        workers.emplace_back([&] {
+            PinyinTransliterator tr(db, options);
+            while (true) {
+                std::size_t b;
+                {
+                    std::unique_lock lock(mutex);
+                    blockWritten.wait(lock, [&] { return nextBlock >= blocks.size() || nextBlock < numWritten + window; });
+                    if (nextBlock >= blocks.size()) {
+                        return;
+                    }
+                    b = nextBlock++;
+                }
+                convertBlock(tr, blocks[b]);
+                {
+                    std::lock_guard lock(mutex);
+                    blocks[b].done = true;
+                }
+                blockDone.notify_one();
+            }
+        });
+    }
+
+    // written in input order by this thread while later blocks are converted
+    std::size_t numLines = 0, outputBytes = 0;
+    for (std::size_t b = 0; b < blocks.size(); ++b) {
+        {
+            std::unique_lock lock(mutex);
+            blockDone.wait(lock, [&] { return blocks[b].done; });
+        }
+        out.write(blocks[b].output.data(), blocks[b].output.size());
+        numLines += blocks[b].numLines;
+        outputBytes += blocks[b].output.size();
+        std::string().swap(blocks[b].output);
+        {
+            std::lock_guard lock(mutex);
+            numWritten = b + 1;
+        }
+        blockWritten.notify_all();
+    }
+    workers.clear();
+    out.flush();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    seconds = std::max(seconds, 1e-9);
+    std::fprintf(stderr, "%zu lines, %zu bytes in, %zu bytes out, %zu threads, %.3f s, %.2f MB/s, %.0f lines/s\n",
+                 numLines, file.size(), outputBytes, numThreads, seconds, file.size() / seconds / 1e6, numLines / seconds);
+    return out ? 0 : 1;
+}
@@ -0,0 +1,36 @@
+#include <pinyincpp/pinyin_snapshot.hpp>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+using namespace pinyincpp;
+
+// compiles data/pinyin.bin into the snapshot image baked in as data/pinyin.snap, run by the build
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " <pinyin.bin> <pinyin.snap>\n";
+        return 2;
+    }
+    std::ifstream fin(argv[1], std::ios::binary);
+    if (!fin) {
+        std::cerr << "cannot open input file: " << argv[1] << '\n';
+        return 1;
+    }
+    std::string data(std::istreambuf_iterator<char>{fin}, std::istreambuf_iterator<char>{});
+    std::vector<std::uint32_t> image;
+    try {
+        image = PinyinSnapshot::compile(BytesReader(data));
+    } catch (std::exception const &e) {
+        std::cerr << "cannot compile snapshot: " << argv[1] << " (" << e.what() << ")\n";
+        return 1;
+    }
+    std::ofstream fout(argv[2], std::ios::binary);
+    fout.write(reinterpret_cast<const char *>(image.data()), image.size() * sizeof(image[0]));
+    if (!fout) {
+        std::cerr << "cannot write output file: " << argv[2] << '\n';
+        return 1;
+    }
+    return 0;
+}